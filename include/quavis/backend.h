@@ -0,0 +1,114 @@
+#ifndef QUAVIS_BACKEND_H
+#define QUAVIS_BACKEND_H
+
+#include "quavis/vk/geometry/geometry.h"
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace quavis {
+  /**
+  * Thrown by Backend::Parse when the computation has been cancelled. It has
+  * a type of its own, string literals of the backends' libraries and the
+  * services do not share an address.
+  */
+  struct Cancelled {
+    const char *what() const {
+      return "Computation cancelled.";
+    }
+  };
+
+  /**
+  * How the scene is rendered for a metric.
+  */
+  enum RenderMode {
+    RENDER_MODE_CENTER = 0, // distance at each pixel center
+    RENDER_MODE_NEAREST = 1, // nearest distance of each primitive touching a pixel (see shader.geom)
+    RENDER_MODE_COUNT = 2
+  };
+
+  /**
+  * The pipeline statistics collected per render, in the order the device
+  * reports them.
+  */
+  enum PipelineStatistic {
+    PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES = 0, // triangles (patches) drawn
+    PIPELINE_STATISTIC_GEOMETRY_SHADER_INVOCATIONS = 1, // triangles emitted by the tessellator
+    PIPELINE_STATISTIC_GEOMETRY_SHADER_PRIMITIVES = 2, // triangles emitted by the geometry shader
+    PIPELINE_STATISTIC_CLIPPING_PRIMITIVES = 3, // triangles left after clipping
+    PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS = 4,
+    PIPELINE_STATISTIC_TESSELLATION_EVALUATION_INVOCATIONS = 5, // vertices emitted by the tessellator
+    PIPELINE_STATISTIC_COUNT = 6
+  };
+
+  static const char *const pipeline_statistic_names[PIPELINE_STATISTIC_COUNT] = {
+    "input_assembly_primitives",
+    "geometry_shader_invocations",
+    "geometry_shader_primitives",
+    "clipping_primitives",
+    "fragment_shader_invocations",
+    "tessellation_evaluation_invocations"
+  };
+
+  /**
+  * The render mode a metric is computed from. The radial metrics need the
+  * nearest distance, such that thin geometry is not missed.
+  */
+  inline RenderMode metric_render_mode(std::string name) {
+    return (name == "minradial" || name == "maxradial") ? RENDER_MODE_NEAREST : RENDER_MODE_CENTER;
+  }
+
+  /**
+  * The interface of the isovist computations, implemented on the device by
+  * Context and on the CPU by cpu::Context. Implementations are not
+  * thread-safe, every thread uses its own.
+  */
+  class Backend {
+  public:
+    virtual ~Backend() {}
+
+    /**
+    * Computes the given metrics for every observation point. The scene is
+    * kept, such that following calls on the same scenario skip parsing it.
+    * The points are read in place, they have to stay valid until the call
+    * returns.
+    *
+    * cancelled is polled (from the calling thread) before every observation
+    * point. Once it returns true, the call throws Cancelled and the backend
+    * can be used for the next call.
+    */
+    virtual std::map<std::string, std::vector<float>> Parse(const std::string& contents, vec3_span analysispoints, float alpha_max, float r_max, std::vector<std::string> metrics, std::function<bool()> cancelled = nullptr) = 0;
+
+    /**
+    * Returns the number of primitives generated for each observation point
+    * of the last call to Parse. The list is empty if the backend does not
+    * count them.
+    */
+    virtual std::vector<uint64_t> GetPrimitiveCounts() = 0;
+
+    /**
+    * Returns the pipeline statistics of the last call to Parse summed over
+    * all observation points, by the names in pipeline_statistic_names. The
+    * map is empty if the backend does not collect them.
+    */
+    virtual std::map<std::string, uint64_t> GetPipelineStatistics() = 0;
+
+    /**
+    * Returns the seconds spent in each stage of the last call to Parse, e.g.
+    * "load_scene", "render" and "reduce". Stages of several points computed
+    * in parallel are summed. Stages a backend does not measure are missing.
+    */
+    virtual std::map<std::string, double> GetStageTimes() = 0;
+
+    /**
+    * Returns the bytes of device memory allocated by the backend, 0 if it
+    * does not use a device.
+    */
+    virtual uint64_t GetDeviceMemory() = 0;
+  };
+}
+
+#endif // QUAVIS_BACKEND_H
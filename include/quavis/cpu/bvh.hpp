@@ -0,0 +1,481 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include <vector>
+#include <algorithm> // min, max, partition
+#include <numeric> // iota
+#include <float.h> // FLT_MAX
+#include <stdint.h>
+
+#include "quavis/vk/geometry/geometry.h"
+
+namespace quavis {
+  namespace cpu {
+    struct Triangle {
+      vec3 a;
+      vec3 b;
+      vec3 c;
+    };
+
+    /**
+     * A node of the bounding volume hierarchy. Leaves (count > 0) reference
+     * the triangles [first, first + count), inner nodes their two children
+     * at first and first + 1.
+     */
+    struct BvhNode {
+      vec3 min;
+      uint32_t first;
+      vec3 max;
+      uint32_t count;
+    };
+
+    /**
+     * A bounding volume hierarchy over triangles. The triangles are reordered
+     * such that the triangles of every leaf are contiguous.
+     */
+    struct Bvh {
+      std::vector<BvhNode> nodes;
+      std::vector<Triangle> triangles;
+    };
+
+    inline vec3 min(vec3 a, vec3 b) {
+      return {std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z)};
+    }
+
+    inline vec3 max(vec3 a, vec3 b) {
+      return {std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z)};
+    }
+
+    inline float component(vec3 v, int axis) {
+      return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+    }
+
+    inline vec3 cross(vec3 a, vec3 b) {
+      return {a.y*b.z - a.z*b.y, a.z*b.x - a.x*b.z, a.x*b.y - a.y*b.x};
+    }
+
+    /**
+     * Half the surface area of a box, the SAH only needs relative areas.
+     */
+    inline float half_area(vec3 bmin, vec3 bmax) {
+      vec3 d = bmax - bmin;
+      if (d.x < 0 || d.y < 0 || d.z < 0)
+        return 0;
+      return d.x*d.y + d.y*d.z + d.z*d.x;
+    }
+
+    /**
+     * Builds a bounding volume hierarchy with binned surface area heuristic
+     * splits (Wald, On fast Construction of SAH-based Bounding Volume
+     * Hierarchies, 2007).
+     */
+    inline Bvh build_bvh(std::vector<Triangle> triangles) {
+      const int num_bins = 16;
+      const uint32_t max_leaf_size = 4;
+      const uint32_t max_depth = 60; // the traversal stacks hold 64 nodes
+
+      Bvh bvh;
+      if (triangles.empty())
+        return bvh;
+
+      std::vector<vec3> tmin(triangles.size()), tmax(triangles.size()), centroids(triangles.size());
+      for (size_t t = 0; t < triangles.size(); t++) {
+        tmin[t] = min(triangles[t].a, min(triangles[t].b, triangles[t].c));
+        tmax[t] = max(triangles[t].a, max(triangles[t].b, triangles[t].c));
+        centroids[t] = (tmin[t] + tmax[t]) * 0.5f;
+      }
+
+      std::vector<uint32_t> order(triangles.size());
+      std::iota(order.begin(), order.end(), 0);
+
+      bvh.nodes.push_back({{0, 0, 0}, 0, {0, 0, 0}, (uint32_t)triangles.size()});
+      std::vector<std::pair<uint32_t, uint32_t>> stack = {{0, 0}}; // node and depth
+      while (!stack.empty()) {
+        uint32_t index = stack.back().first, depth = stack.back().second;
+        BvhNode& node = bvh.nodes[index];
+        stack.pop_back();
+
+        // bounds of the triangles and of their centroids
+        vec3 cmin = centroids[order[node.first]], cmax = cmin;
+        node.min = tmin[order[node.first]];
+        node.max = tmax[order[node.first]];
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+          node.min = min(node.min, tmin[order[i]]);
+          node.max = max(node.max, tmax[order[i]]);
+          cmin = min(cmin, centroids[order[i]]);
+          cmax = max(cmax, centroids[order[i]]);
+        }
+        if (node.count <= max_leaf_size || depth >= max_depth)
+          continue;
+
+        // find the cheapest split among the bin boundaries of all axes
+        float best_cost = node.count * half_area(node.min, node.max);
+        int best_axis = -1, best_split = 0;
+        for (int axis = 0; axis < 3; axis++) {
+          float lo = component(cmin, axis), extent = component(cmax, axis) - lo;
+          if (extent <= 0)
+            continue;
+
+          uint32_t counts[num_bins] = {0};
+          vec3 bmins[num_bins], bmaxs[num_bins];
+          for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            int bin = std::min(num_bins - 1, (int)(num_bins * (component(centroids[order[i]], axis) - lo) / extent));
+            bmins[bin] = counts[bin] == 0 ? tmin[order[i]] : min(bmins[bin], tmin[order[i]]);
+            bmaxs[bin] = counts[bin] == 0 ? tmax[order[i]] : max(bmaxs[bin], tmax[order[i]]);
+            counts[bin]++;
+          }
+
+          // sweep from the right, then from the left
+          float right_area[num_bins];
+          uint32_t right_count[num_bins];
+          vec3 rmin = {FLT_MAX, FLT_MAX, FLT_MAX}, rmax = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+          uint32_t count = 0;
+          for (int b = num_bins - 1; b > 0; b--) {
+            if (counts[b] > 0) {
+              rmin = min(rmin, bmins[b]);
+              rmax = max(rmax, bmaxs[b]);
+            }
+            count += counts[b];
+            right_area[b] = half_area(rmin, rmax);
+            right_count[b] = count;
+          }
+
+          vec3 lmin = {FLT_MAX, FLT_MAX, FLT_MAX}, lmax = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+          count = 0;
+          for (int b = 0; b < num_bins - 1; b++) {
+            if (counts[b] > 0) {
+              lmin = min(lmin, bmins[b]);
+              lmax = max(lmax, bmaxs[b]);
+            }
+            count += counts[b];
+            float cost = count * half_area(lmin, lmax) + right_count[b+1] * right_area[b+1];
+            if (count > 0 && right_count[b+1] > 0 && cost < best_cost) {
+              best_cost = cost;
+              best_axis = axis;
+              best_split = b + 1;
+            }
+          }
+        }
+        if (best_axis < 0)
+          continue;
+
+        // partition the triangles at the split and create the children
+        float lo = component(cmin, best_axis), extent = component(cmax, best_axis) - lo;
+        uint32_t *middle = std::partition(&order[node.first], &order[node.first] + node.count, [&](uint32_t t) {
+          return std::min(num_bins - 1, (int)(num_bins * (component(centroids[t], best_axis) - lo) / extent)) < best_split;
+        });
+        uint32_t left_count = (uint32_t)(middle - &order[node.first]);
+
+        uint32_t first = node.first, count = node.count;
+        uint32_t children = (uint32_t)bvh.nodes.size();
+        bvh.nodes.push_back({{0, 0, 0}, first, {0, 0, 0}, left_count});
+        bvh.nodes.push_back({{0, 0, 0}, first + left_count, {0, 0, 0}, count - left_count});
+        bvh.nodes[index].first = children; // node is invalidated by push_back
+        bvh.nodes[index].count = 0;
+        stack.push_back({children, depth + 1});
+        stack.push_back({children + 1, depth + 1});
+      }
+
+      bvh.triangles.resize(triangles.size());
+      for (size_t i = 0; i < order.size(); i++)
+        bvh.triangles[i] = triangles[order[i]];
+      return bvh;
+    }
+
+    /**
+     * Slab test of the ray against a box. Returns the entry distance or
+     * FLT_MAX if the box is missed within [0, t_max].
+     */
+    inline float intersect_box(const BvhNode& node, vec3 origin, vec3 inv_direction, float t_max) {
+      float tx1 = (node.min.x - origin.x) * inv_direction.x, tx2 = (node.max.x - origin.x) * inv_direction.x;
+      float ty1 = (node.min.y - origin.y) * inv_direction.y, ty2 = (node.max.y - origin.y) * inv_direction.y;
+      float tz1 = (node.min.z - origin.z) * inv_direction.z, tz2 = (node.max.z - origin.z) * inv_direction.z;
+      float tnear = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::max(std::min(tz1, tz2), 0.0f));
+      float tfar = std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), std::min(std::max(tz1, tz2), t_max));
+      return tnear <= tfar ? tnear : FLT_MAX;
+    }
+
+    /**
+     * Two-sided ray triangle intersection (Moeller, Trumbore, Fast, Minimum
+     * Storage Ray/Triangle Intersection, 1997). Returns the distance along the
+     * ray or FLT_MAX, and the barycentric coordinates u and v (the weights of
+     * b and c) of the hit.
+     */
+    inline float intersect_triangle(Triangle triangle, vec3 origin, vec3 direction, float& u, float& v) {
+      vec3 e1 = triangle.b - triangle.a, e2 = triangle.c - triangle.a;
+      vec3 p = cross(direction, e2);
+      float det = e1 * p;
+      if (det > -1e-12f && det < 1e-12f)
+        return FLT_MAX;
+
+      float inv_det = 1.0f / det;
+      vec3 s = origin - triangle.a;
+      u = (s * p) * inv_det;
+      if (u < 0 || u > 1)
+        return FLT_MAX;
+
+      vec3 q = cross(s, e1);
+      v = (direction * q) * inv_det;
+      if (v < 0 || u + v > 1)
+        return FLT_MAX;
+
+      float t = (e2 * q) * inv_det;
+      return t > EPS ? t : FLT_MAX;
+    }
+
+    inline float intersect_triangle(Triangle triangle, vec3 origin, vec3 direction) {
+      float u, v;
+      return intersect_triangle(triangle, origin, direction, u, v);
+    }
+
+    /**
+     * Closest point of the triangle abc to the origin, see shader.geom.
+     */
+    inline vec3 closest_point_to_origin(vec3 a, vec3 b, vec3 c) {
+      vec3 ab = b - a, ac = c - a;
+      vec3 na = a * -1, nb = b * -1, nc = c * -1;
+
+      float d1 = ab * na, d2 = ac * na;
+      if (d1 <= 0 && d2 <= 0) return a;
+
+      float d3 = ab * nb, d4 = ac * nb;
+      if (d3 >= 0 && d4 <= d3) return b;
+
+      float vc = d1*d4 - d3*d2;
+      if (vc <= 0 && d1 >= 0 && d3 <= 0) return a + ab * (d1 / (d1 - d3));
+
+      float d5 = ab * nc, d6 = ac * nc;
+      if (d6 >= 0 && d5 <= d6) return c;
+
+      float vb = d5*d2 - d1*d6;
+      if (vb <= 0 && d2 >= 0 && d6 <= 0) return a + ac * (d2 / (d2 - d6));
+
+      float va = d3*d6 - d5*d4;
+      if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+      float denom = 1.0f / (va + vb + vc);
+      return a + ab * (vb * denom) + ac * (vc * denom);
+    }
+
+    /**
+     * Angle in radians between the directions of a and b.
+     */
+    inline float angle(vec3 a, vec3 b) {
+      vec3 n = cross(a, b);
+      return atan2f(sqrtf(n * n), a * b);
+    }
+
+    const float MAX_TESSELLATION_LEVEL = 64; // the minimum gl_MaxTessGenLevel
+
+    /**
+     * The number of segments the device divides the edges of the triangle abc
+     * into, such that each segment spans at most alpha radians as seen from
+     * the origin, see shader.tesc.
+     */
+    inline float tessellation_level(vec3 a, vec3 b, vec3 c, float alpha) {
+      float level = std::max(std::max(angle(a, b), angle(a, c)), angle(b, c)) / alpha;
+      return std::min(std::max(ceilf(level), 1.0f), MAX_TESSELLATION_LEVEL);
+    }
+
+    /**
+     * The fraction of the segment pq at which it is seen at the given angle
+     * from p, as seen from the origin.
+     */
+    inline float fraction_at_angle(vec3 p, vec3 q, float alpha) {
+      vec3 n = cross(p, q);
+      float k = (p * p) * sinf(alpha) / ((p * p - p * q) * sinf(alpha) + sqrtf(n * n) * cosf(alpha));
+      return std::min(std::max(k, 0.0f), 1.0f);
+    }
+
+    /**
+     * The point of the triangle abc at the tessellation coordinates (s, t, u)
+     * (the weights of a, b and c), see shader.tese: the coordinates are
+     * spaced evenly in angle as seen from the origin, not along the edges.
+     */
+    inline vec3 tessellate(vec3 a, vec3 b, vec3 c, float s, float t, float u) {
+      float k = t <= 0 ? 0 : (s <= 0 ? 1 : fraction_at_angle(a, b, t / (s + t) * angle(a, b)));
+      vec3 p = a * (1 - k) + b * k;
+      float l = fraction_at_angle(p, c, u * angle(p, c));
+      return p * (1 - l) + c * l;
+    }
+
+    /**
+     * The tessellation coordinates t and u of the point of the triangle abc
+     * with the barycentric coordinates v and w (the weights of b and c), the
+     * inverse of tessellate.
+     */
+    inline void tessellation_coordinates(vec3 a, vec3 b, vec3 c, float v, float w, float& t, float& u) {
+      // the point lies on the segment from p on ab to c
+      float k = w < 1 ? v / (1 - w) : 0;
+      vec3 p = a * (1 - k) + b * k;
+      vec3 x = p * (1 - w) + c * w;
+      float ab = angle(a, b), pc = angle(p, c);
+      u = pc > 0 ? std::min(angle(p, x) / pc, 1.0f) : 0;
+      t = (1 - u) * (ab > 0 ? std::min(angle(a, p) / ab, 1.0f) : 0);
+    }
+
+    /**
+     * A subtriangle of the uniform grid over the tessellation coordinates t
+     * and u: the lower or the upper half of the cell (i, j).
+     */
+    struct GridCell {
+      float i;
+      float j;
+      bool upper;
+
+      bool operator==(const GridCell& other) const {
+        return i == other.i && j == other.j && upper == other.upper;
+      }
+    };
+
+    /**
+     * The subtriangle of the grid of the given level over the triangle abc
+     * that contains the barycentric coordinates v and w (the weights of b and
+     * c). The device's tessellator arranges the subtriangles in concentric
+     * rings, the uniform grid has the same level and thus subtriangles of the
+     * same angular size.
+     */
+    inline GridCell grid_cell(vec3 a, vec3 b, vec3 c, float v, float w, float level) {
+      float t, u;
+      tessellation_coordinates(a, b, c, v, w, t, u);
+      GridCell cell = {std::min(floorf(t * level), level - 1), std::min(floorf(u * level), level - 1), false};
+      cell.upper = t * level - cell.i + u * level - cell.j > 1;
+
+      // cells on the edge bc only have the lower half
+      while (cell.i + cell.j > level - 1) {
+        if (cell.i > 0) cell.i--; else cell.j--;
+        cell.upper = false;
+      }
+      return cell;
+    }
+
+    inline Triangle grid_subtriangle(vec3 a, vec3 b, vec3 c, GridCell cell, float level) {
+      auto corner = [&](float i, float j) {
+        return tessellate(a, b, c, 1 - (i + j) / level, i / level, j / level);
+      };
+      if (cell.upper)
+        return {corner(cell.i + 1, cell.j), corner(cell.i, cell.j + 1), corner(cell.i + 1, cell.j + 1)};
+      return {corner(cell.i, cell.j), corner(cell.i + 1, cell.j), corner(cell.i, cell.j + 1)};
+    }
+
+    /**
+     * The subtriangle of abc (relative to the observer) that the device
+     * renders at the barycentric coordinates v and w when it tessellates for
+     * alpha.
+     */
+    inline Triangle rendered_subtriangle(vec3 a, vec3 b, vec3 c, float v, float w, float alpha) {
+      float level = tessellation_level(a, b, c, alpha);
+      if (level == 1)
+        return {a, b, c};
+      return grid_subtriangle(a, b, c, grid_cell(a, b, c, v, w, level), level);
+    }
+
+    /**
+     * Distance of the first triangle hit by the ray within t_max, or FLT_MAX.
+     */
+    inline float intersect(const Bvh& bvh, vec3 origin, vec3 direction, float t_max) {
+      if (bvh.nodes.empty())
+        return FLT_MAX;
+
+      vec3 inv_direction = {1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z};
+      float t = t_max;
+      bool hit = false;
+
+      uint32_t stack[64];
+      int size = 0;
+      if (intersect_box(bvh.nodes[0], origin, inv_direction, t) == FLT_MAX)
+        return FLT_MAX;
+      stack[size++] = 0;
+      while (size > 0) {
+        const BvhNode& node = bvh.nodes[stack[--size]];
+        if (node.count > 0) {
+          for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            float ti = intersect_triangle(bvh.triangles[i], origin, direction);
+            if (ti <= t) {
+              t = ti;
+              hit = true;
+            }
+          }
+          continue;
+        }
+
+        // visit the nearer child first
+        float t0 = intersect_box(bvh.nodes[node.first], origin, inv_direction, t);
+        float t1 = intersect_box(bvh.nodes[node.first + 1], origin, inv_direction, t);
+        if (t0 > t1) {
+          if (t0 != FLT_MAX) stack[size++] = node.first;
+          stack[size++] = node.first + 1;
+        } else {
+          if (t1 != FLT_MAX) stack[size++] = node.first + 1;
+          if (t0 != FLT_MAX) stack[size++] = node.first;
+        }
+      }
+      return hit ? t : FLT_MAX;
+    }
+
+    /**
+     * Squared distance of the origin to a box (0 if it is inside).
+     */
+    inline float distance2(const BvhNode& node, vec3 origin) {
+      float dx = std::max(0.0f, std::max(node.min.x - origin.x, origin.x - node.max.x));
+      float dy = std::max(0.0f, std::max(node.min.y - origin.y, origin.y - node.max.y));
+      float dz = std::max(0.0f, std::max(node.min.z - origin.z, origin.z - node.max.z));
+      return dx*dx + dy*dy + dz*dz;
+    }
+
+    /**
+     * The smallest distance of the origin to any triangle hit by the ray (at
+     * any distance), if it is below max_distance, or FLT_MAX. This is the
+     * CPU equivalent of the nearest render mode, where each pixel keeps the
+     * nearest distance of all subtriangles covering it: a triangle counts
+     * with the subtriangle it is hit in when tessellated for alpha (see
+     * rendered_subtriangle).
+     */
+    inline float intersect_nearest(const Bvh& bvh, vec3 origin, vec3 direction, float max_distance, float alpha) {
+      if (bvh.nodes.empty())
+        return FLT_MAX;
+
+      vec3 inv_direction = {1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z};
+      float best2 = max_distance * max_distance;
+      bool hit = false;
+
+      uint32_t stack[64];
+      int size = 0;
+      stack[size++] = 0;
+      while (size > 0) {
+        const BvhNode& node = bvh.nodes[stack[--size]];
+        // no triangle of the box can be nearer than the box itself
+        if (distance2(node, origin) > best2 || intersect_box(node, origin, inv_direction, FLT_MAX) == FLT_MAX)
+          continue;
+
+        if (node.count > 0) {
+          for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            Triangle triangle = bvh.triangles[i];
+            float v, w;
+            if (intersect_triangle(triangle, origin, direction, v, w) == FLT_MAX)
+              continue;
+
+            // the whole triangle is never nearer than its subtriangles
+            vec3 a = triangle.a - origin, b = triangle.b - origin, c = triangle.c - origin;
+            vec3 p = closest_point_to_origin(a, b, c);
+            if (p * p > best2)
+              continue;
+            Triangle part = rendered_subtriangle(a, b, c, v, w, alpha);
+            p = closest_point_to_origin(part.a, part.b, part.c);
+            if (p * p <= best2) {
+              best2 = p * p;
+              hit = true;
+            }
+          }
+          continue;
+        }
+
+        stack[size++] = node.first;
+        stack[size++] = node.first + 1;
+      }
+      return hit ? sqrt(best2) : FLT_MAX;
+    }
+  }
+}
+
+#endif // BVH_HPP
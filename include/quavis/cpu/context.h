@@ -0,0 +1,93 @@
+#ifndef QUAVIS_CPU_CONTEXT_H
+#define QUAVIS_CPU_CONTEXT_H
+
+#include "quavis/backend.h"
+#include "quavis/cpu/bvh.hpp"
+#include "quavis/cpu/packet.h"
+#include "quavis/vk/geometry/geometry.h"
+
+#include <string>
+#include <vector>
+
+namespace quavis {
+  namespace cpu {
+    /**
+    * The isovist metrics computed on the CPU. Instead of rasterizing the
+    * scene, a ray is cast for every pixel of the spherical image against a
+    * bounding volume hierarchy of the scene's triangles. Neighbouring pixels
+    * are traced together in packets of 16 (AVX-512) or 8 (AVX2) rays where the
+    * processor supports it. The observation points are distributed over a
+    * number of threads.
+    *
+    * The metrics are reduced exactly like the shader.*.comp compute shaders,
+    * such that results can be compared with the device's. Pixels are sampled
+    * at their centers, geometry thinner than a pixel may be missed where the
+    * device rasterizes conservatively.
+    */
+    class Context : public Backend {
+    public:
+      /**
+      * Creates a context for the given metrics. num_threads = 0 uses one
+      * thread per hardware thread. kernel forces a packet kernel (see
+      * select_packet_kernel), empty picks the widest supported one.
+      */
+      Context(std::vector<std::string> metrics, size_t num_threads = 0, uint32_t width = 128, uint32_t height = 64, std::string kernel = "");
+
+      std::map<std::string, std::vector<float>> Parse(const std::string& contents, vec3_span analysispoints, float alpha_max, float r_max, std::vector<std::string> metrics, std::function<bool()> cancelled = nullptr) override;
+
+      /**
+      * Always empty, the CPU renders no primitives.
+      */
+      std::vector<uint64_t> GetPrimitiveCounts() override;
+
+      /**
+      * Always empty, the CPU has no pipeline.
+      */
+      std::map<std::string, uint64_t> GetPipelineStatistics() override;
+
+      std::map<std::string, double> GetStageTimes() override;
+      uint64_t GetDeviceMemory() override;
+
+      /**
+      * The name of the packet kernel used.
+      */
+      std::string GetKernelName() { return this->kernel_name_; }
+
+    private:
+      struct Metric {
+        std::string name;
+        RenderMode render_mode;
+      };
+
+      void LoadScene(const std::string& contents);
+      size_t GetMetricIndex(std::string name);
+
+      /**
+      * Renders the spherical image seen from the observer: for every pixel the
+      * distance divided by r_max (0 if nothing is visible) and the coverage.
+      * The nearest mode tessellates like the device for alpha_max.
+      */
+      void Render(vec3 observer, float r_max, float alpha_max, RenderMode mode, std::vector<float>& distances, std::vector<vec2>& image);
+      float Reduce(const std::string& metric, const std::vector<vec2>& image);
+
+      std::vector<Metric> metrics_ = {};
+      size_t num_threads_;
+      const uint32_t width_;
+      const uint32_t height_;
+      std::vector<float> directions_x_ = {}; // direction of every pixel center
+      std::vector<float> directions_y_ = {};
+      std::vector<float> directions_z_ = {};
+      std::string kernel_name_;
+      PacketKernel kernel_;
+
+      bool scene_loaded_ = false;
+      std::string scene_contents_ = "";
+      Bvh bvh_;
+      TriangleSoA triangles_;
+
+      std::map<std::string, double> stage_times_ = {};
+    };
+  }
+}
+
+#endif // QUAVIS_CPU_CONTEXT_H
@@ -0,0 +1,81 @@
+#ifndef QUAVIS_CPU_PACKET_H
+#define QUAVIS_CPU_PACKET_H
+
+#include "quavis/cpu/bvh.hpp"
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+
+namespace quavis {
+  namespace cpu {
+    /**
+    * The triangles of a hierarchy in structure of arrays layout (a corner and
+    * the two edges from it), such that packet kernels can load them without
+    * gathering.
+    */
+    struct TriangleSoA {
+      std::vector<float> ax, ay, az;
+      std::vector<float> e1x, e1y, e1z;
+      std::vector<float> e2x, e2y, e2z;
+    };
+
+    inline TriangleSoA to_soa(const std::vector<Triangle>& triangles) {
+      TriangleSoA soa;
+      for (Triangle t : triangles) {
+        vec3 e1 = t.b - t.a, e2 = t.c - t.a;
+        soa.ax.push_back(t.a.x); soa.ay.push_back(t.a.y); soa.az.push_back(t.a.z);
+        soa.e1x.push_back(e1.x); soa.e1y.push_back(e1.y); soa.e1z.push_back(e1.z);
+        soa.e2x.push_back(e2.x); soa.e2y.push_back(e2.y); soa.e2z.push_back(e2.z);
+      }
+      return soa;
+    }
+
+    /**
+    * Plain views of a hierarchy for the kernels. The kernels are compiled for
+    * different instruction sets and therefore do not touch std containers.
+    */
+    struct PacketScene {
+      const BvhNode *nodes;
+      size_t num_nodes;
+      const float *ax, *ay, *az;
+      const float *e1x, *e1y, *e1z;
+      const float *e2x, *e2y, *e2z;
+    };
+
+    /**
+    * Rays sharing one origin, their directions in structure of arrays layout.
+    * Consecutive rays should be neighbouring pixels, they are traced together.
+    */
+    struct PacketRays {
+      float ox, oy, oz;
+      const float *dx, *dy, *dz;
+      size_t count;
+    };
+
+    /**
+    * Writes the distance of every ray, or FLT_MAX if nothing within
+    * max_distance is hit. With nearest set, the distance is the smallest
+    * distance of the origin to any subtriangle hit by the ray (at any
+    * distance) when the triangles are tessellated for alpha, as in
+    * intersect_nearest; otherwise the distance along the ray, as in
+    * intersect.
+    */
+    typedef void (*PacketKernel)(const PacketScene& scene, const PacketRays& rays, float max_distance, bool nearest, float alpha, float *distances);
+
+    void cast_packets_scalar(const PacketScene& scene, const PacketRays& rays, float max_distance, bool nearest, float alpha, float *distances);
+#ifdef QUAVIS_CPU_SIMD
+    void cast_packets_avx2(const PacketScene& scene, const PacketRays& rays, float max_distance, bool nearest, float alpha, float *distances); // 8 rays
+    void cast_packets_avx512(const PacketScene& scene, const PacketRays& rays, float max_distance, bool nearest, float alpha, float *distances); // 16 rays
+#endif
+
+    /**
+    * Returns the widest kernel supported by the processor, or the one with the
+    * given name ("avx512", "avx2" or "scalar"). name is set to the kernel
+    * returned.
+    */
+    PacketKernel select_packet_kernel(std::string& name);
+  }
+}
+
+#endif // QUAVIS_CPU_PACKET_H
@@ -0,0 +1,140 @@
+#ifndef QUAVIS_JOBQUEUE_H
+#define QUAVIS_JOBQUEUE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+namespace quavis {
+  /**
+  * A queue of jobs that are executed by a fixed number of worker threads.
+  * Every job receives the index of the worker running it, such that workers
+  * can keep their own (non thread-safe) resources, e.g. a Context.
+  *
+  * Jobs with a higher priority are started first, jobs of equal priority in
+  * the order they were pushed. Running jobs are never interrupted, long work
+  * is preempted by splitting it into jobs that push their continuation.
+  * Delayed jobs wait outside of the queue and do not hold up a worker.
+  */
+  class JobQueue {
+  public:
+    typedef std::function<void(size_t worker)> Job;
+
+    /**
+    * Starts the given number of worker threads (at least one).
+    */
+    JobQueue(size_t num_workers) {
+      if (num_workers == 0)
+        num_workers = 1;
+      for (size_t i = 0; i < num_workers; i++)
+        this->workers_.push_back(std::thread(&JobQueue::Work, this, i));
+    }
+
+    /**
+    * Finishes all queued jobs, delayed ones without waiting for their time,
+    * and stops the worker threads.
+    */
+    ~JobQueue() {
+      {
+        std::lock_guard<std::mutex> lock(this->mutex_);
+        this->stopped_ = true;
+      }
+      this->condition_.notify_all();
+      for (std::thread& worker : this->workers_)
+        worker.join();
+    }
+
+    /**
+    * Adds a job behind all queued jobs of the same or a higher priority. The
+    * call returns immediately.
+    */
+    void Push(Job job, int priority = 0) {
+      {
+        std::lock_guard<std::mutex> lock(this->mutex_);
+        this->jobs_.push({priority, this->next_sequence_++, job});
+      }
+      this->condition_.notify_one();
+    }
+
+    /**
+    * Adds a job that is queued at the given time, behind all queued jobs of
+    * the same or a higher priority at that time.
+    */
+    void Push(Job job, int priority, std::chrono::steady_clock::time_point not_before) {
+      {
+        std::lock_guard<std::mutex> lock(this->mutex_);
+        this->delayed_.insert({not_before, {priority, 0, job}});
+      }
+      // waiting workers have to wake up earlier
+      this->condition_.notify_all();
+    }
+
+    size_t GetNumWorkers() {
+      return this->workers_.size();
+    }
+
+  private:
+    struct QueuedJob {
+      int priority;
+      uint64_t sequence;
+      Job job;
+
+      bool operator<(const QueuedJob& other) const {
+        // std::priority_queue pops the greatest element
+        if (priority != other.priority)
+          return priority < other.priority;
+        return sequence > other.sequence;
+      }
+    };
+
+    void Work(size_t worker) {
+      while (true) {
+        Job job;
+        {
+          std::unique_lock<std::mutex> lock(this->mutex_);
+          while (true) {
+            this->QueueDelayed();
+            if (!this->jobs_.empty())
+              break;
+            if (this->stopped_)
+              return;
+            if (this->delayed_.empty())
+              this->condition_.wait(lock);
+            else
+              this->condition_.wait_until(lock, this->delayed_.begin()->first);
+          }
+          job = this->jobs_.top().job;
+          this->jobs_.pop();
+        }
+        job(worker);
+      }
+    }
+
+    // queues the delayed jobs whose time has come, requires mutex_
+    void QueueDelayed() {
+      std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      while (!this->delayed_.empty() && (this->stopped_ || this->delayed_.begin()->first <= now)) {
+        QueuedJob queued = this->delayed_.begin()->second;
+        queued.sequence = this->next_sequence_++;
+        this->jobs_.push(queued);
+        this->delayed_.erase(this->delayed_.begin());
+      }
+    }
+
+    std::vector<std::thread> workers_;
+    std::priority_queue<QueuedJob> jobs_;
+    std::multimap<std::chrono::steady_clock::time_point, QueuedJob> delayed_; // by the time they are queued at
+    uint64_t next_sequence_ = 0;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool stopped_ = false;
+  };
+}
+
+#endif // QUAVIS_JOBQUEUE_H
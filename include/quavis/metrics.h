@@ -0,0 +1,277 @@
+#ifndef QUAVIS_METRICS_H
+#define QUAVIS_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace quavis {
+  enum MetricType {
+    METRIC_COUNTER,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM
+  };
+
+  static const char *const metric_type_names[] = {"counter", "gauge", "histogram"};
+
+  /**
+  * Upper bounds of latency histograms in seconds.
+  */
+  static const std::vector<double> latency_buckets = {0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5, 10, 30, 60, 300};
+
+  /**
+  * Counters, gauges and histograms of a process, rendered in the Prometheus
+  * text format. Metrics are declared once with Describe, their series (one
+  * per set of labels) are created when they are first updated. All methods
+  * may be called from any thread.
+  */
+  class MetricsRegistry {
+  public:
+    typedef std::map<std::string, std::string> Labels;
+
+    /**
+    * Declares a metric. Histograms count the observations up to each of
+    * the given upper bounds.
+    */
+    void Describe(std::string name, MetricType type, std::string help, std::vector<double> buckets = {}) {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      Family& family = this->families_[name];
+      family.type = type;
+      family.help = help;
+      family.buckets = buckets;
+    }
+
+    /**
+    * Increases a counter or gauge.
+    */
+    void Add(std::string name, double value, Labels labels = {}) {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      this->GetSeries(name, labels).value += value;
+    }
+
+    /**
+    * Sets a gauge.
+    */
+    void Set(std::string name, double value, Labels labels = {}) {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      this->GetSeries(name, labels).value = value;
+    }
+
+    /**
+    * Adds an observation to a histogram.
+    */
+    void Observe(std::string name, double value, Labels labels = {}) {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      Series& series = this->GetSeries(name, labels);
+      const std::vector<double>& buckets = this->families_[name].buckets;
+      if (series.buckets.size() != buckets.size())
+        series.buckets = std::vector<uint64_t>(buckets.size(), 0);
+      for (size_t b = 0; b < buckets.size(); b++)
+        if (value <= buckets[b])
+          series.buckets[b]++;
+      series.value += value;
+      series.count++;
+    }
+
+    /**
+    * Returns all metrics in the Prometheus text exposition format.
+    */
+    std::string Render() {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      std::ostringstream out;
+      out.precision(15);
+      for (auto& it : this->families_) {
+        const std::string& name = it.first;
+        Family& family = it.second;
+        out << "# HELP " << name << " " << family.help << "\n";
+        out << "# TYPE " << name << " " << metric_type_names[family.type] << "\n";
+        for (auto& series : family.series) {
+          if (family.type != METRIC_HISTOGRAM) {
+            out << name << FormatLabels(series.first) << " " << series.second.value << "\n";
+            continue;
+          }
+
+          // buckets are cumulative, the last one (+Inf) counts all
+          for (size_t b = 0; b < family.buckets.size(); b++) {
+            std::ostringstream bound;
+            bound << family.buckets[b];
+            out << name << "_bucket" << FormatLabels(series.first, bound.str()) << " " << series.second.buckets[b] << "\n";
+          }
+          out << name << "_bucket" << FormatLabels(series.first, "+Inf") << " " << series.second.count << "\n";
+          out << name << "_sum" << FormatLabels(series.first) << " " << series.second.value << "\n";
+          out << name << "_count" << FormatLabels(series.first) << " " << series.second.count << "\n";
+        }
+      }
+      return out.str();
+    }
+
+  private:
+    struct Series {
+      double value = 0; // the sum of the observations of a histogram
+      uint64_t count = 0;
+      std::vector<uint64_t> buckets = {};
+    };
+
+    struct Family {
+      MetricType type;
+      std::string help;
+      std::vector<double> buckets;
+      std::map<Labels, Series> series = {};
+    };
+
+    Series& GetSeries(std::string name, Labels labels) {
+      auto family = this->families_.find(name);
+      if (family == this->families_.end())
+        throw "Metric not described.";
+      return family->second.series[labels];
+    }
+
+    static std::string FormatLabels(const Labels& labels, std::string le = "") {
+      Labels all = labels;
+      if (!le.empty())
+        all["le"] = le;
+      if (all.empty())
+        return "";
+
+      std::string text = "{";
+      for (auto& label : all) {
+        if (text.size() > 1)
+          text += ",";
+        text += label.first + "=\"";
+        for (char c : label.second) {
+          if (c == '\\' || c == '"')
+            text += '\\';
+          text += c == '\n' ? std::string("\\n") : std::string(1, c);
+        }
+        text += "\"";
+      }
+      return text + "}";
+    }
+
+    std::mutex mutex_;
+    std::map<std::string, Family> families_ = {};
+  };
+
+  /**
+  * Publishes a registry from a thread of its own: rewrites a text file at a
+  * fixed interval (e.g. for the textfile collector of the node exporter)
+  * and/or answers scrapes on a port of the loopback interface. An empty path
+  * or port 0 disables either.
+  */
+  class MetricsExporter {
+  public:
+    MetricsExporter(MetricsRegistry *registry, std::string path, int port, std::chrono::milliseconds interval)
+      : registry_(registry), path_(path), interval_(interval) {
+      if (port > 0) {
+        this->socket_ = socket(AF_INET, SOCK_STREAM, 0);
+        int reuse = 1;
+        setsockopt(this->socket_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (this->socket_ < 0 || bind(this->socket_, (sockaddr *) &address, sizeof(address)) != 0 || listen(this->socket_, 8) != 0) {
+          if (this->socket_ >= 0)
+            close(this->socket_);
+          throw "Could not listen on the metrics port.";
+        }
+      }
+
+      if (this->socket_ >= 0 || !this->path_.empty())
+        this->thread_ = std::thread(&MetricsExporter::Run, this);
+    }
+
+    ~MetricsExporter() {
+      this->stopped_ = true;
+      if (this->thread_.joinable())
+        this->thread_.join();
+      if (!this->path_.empty())
+        this->WriteFile();
+      if (this->socket_ >= 0)
+        close(this->socket_);
+    }
+
+  private:
+    void Run() {
+      std::chrono::steady_clock::time_point next_write = std::chrono::steady_clock::now();
+      while (!this->stopped_) {
+        if (!this->path_.empty() && std::chrono::steady_clock::now() >= next_write) {
+          this->WriteFile();
+          next_write += this->interval_;
+        }
+
+        // wake up regularly to notice being stopped
+        if (this->socket_ < 0) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(100));
+          continue;
+        }
+        pollfd listening = {this->socket_, POLLIN, 0};
+        if (poll(&listening, 1, 100) > 0) {
+          int client = accept(this->socket_, nullptr, nullptr);
+          if (client >= 0) {
+            this->Serve(client);
+            close(client);
+          }
+        }
+      }
+    }
+
+    void WriteFile() {
+      // readers never see a partially written file
+      std::string tmp = this->path_ + ".tmp";
+      {
+        std::ofstream file(tmp);
+        file << this->registry_->Render();
+        if (!file) {
+          std::cout << "WARNING: " << "Could not write the metrics to " << tmp << std::endl;
+          return;
+        }
+      }
+      if (std::rename(tmp.c_str(), this->path_.c_str()) != 0)
+        std::cout << "WARNING: " << "Could not write the metrics to " << this->path_ << std::endl;
+    }
+
+    void Serve(int client) {
+      // every request gets the metrics, the request itself is not parsed
+      char request[1024];
+      pollfd readable = {client, POLLIN, 0};
+      if (poll(&readable, 1, 1000) > 0)
+        recv(client, request, sizeof(request), 0);
+
+      std::string body = this->registry_->Render();
+      std::string response = "HTTP/1.0 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: " + std::to_string(body.size()) + "\r\n"
+        "Connection: close\r\n\r\n" + body;
+      for (size_t sent = 0; sent < response.size();) {
+        ssize_t n = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+          break;
+        sent += n;
+      }
+    }
+
+    MetricsRegistry *registry_;
+    const std::string path_;
+    const std::chrono::milliseconds interval_;
+    int socket_ = -1;
+    std::atomic<bool> stopped_{false};
+    std::thread thread_;
+  };
+}
+
+#endif // QUAVIS_METRICS_H
@@ -2,11 +2,16 @@
 #define QUAVIS_QUAVIS_H
 
 #include "quavis/version.h"
+#include "quavis/backend.h"
 #include "quavis/shaders.h"
+#include "quavis/trace.h"
 #include "quavis/vk/debug.h"
 #include "quavis/vk/geometry/geometry.h"
 #include "quavis/vk/geometry/vertex.h"
 #include "quavis/vk/geometry/geojson.hpp"
+#include "quavis/vk/geometry/tiling.hpp"
+#include "quavis/vk/geometry/lod.hpp"
+#include "quavis/vk/memory/suballocator.hpp"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
@@ -19,8 +24,10 @@
 #include <string.h>
 #include <memory>
 #include <vector>
+#include <map>
 #include <set>
 #include <array>
+#include <functional>
 
 namespace quavis {
   struct UniformBufferObject {
@@ -29,11 +36,51 @@ namespace quavis {
     float alpha_max;
   };
 
+  /**
+  * A metric computed from the rendered image, with its compute pipeline.
+  */
+  struct Metric {
+    std::string name;
+    RenderMode render_mode;
+    VkShaderModule shader;
+    VkPipeline pipeline;
+    VkCommandBuffer commandbuffer;
+  };
+
+  /**
+  * The device work timed with timestamp queries.
+  */
+  enum TimestampStage {
+    TIMESTAMP_SCENE_UPLOAD = 0, // copying the vertices and indices of a scene
+    TIMESTAMP_UPLOAD = 1, // copying the uniform data and resetting the result per observer
+    TIMESTAMP_DRAW = 2, // the render pass
+    TIMESTAMP_REDUCE = 3, // the compute dispatch of a metric
+    TIMESTAMP_READBACK = 4, // copying a result to the host
+    TIMESTAMP_COUNT = 5
+  };
+
+  static const char *const timestamp_stage_names[TIMESTAMP_COUNT] = {"scene_upload", "upload", "draw", "reduce", "readback"};
+
+  /**
+  * Precedes the driver's data in a pipeline cache file. The data is only
+  * used on the device and driver it was created with.
+  */
+  struct PipelineCacheHeader {
+    char magic[4]; // "QVPC"
+    uint32_t version; // of this layout
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint32_t driver_version;
+    uint8_t device_uuid[VK_UUID_SIZE];
+    uint8_t cache_uuid[VK_UUID_SIZE]; // pipelineCacheUUID of the driver
+    uint64_t data_size;
+  };
+
   /**
   * The Context class initializes and prepares the vulkan instance for fast
   * computations on the graphics card.
   */
-  class Context {
+  class Context : public Backend {
   public:
     /**
     * Creates a new instance of the Context class. During its initialization,
@@ -41,7 +88,59 @@ namespace quavis {
     */
     Context(std::string compute_shader);
 
-    std::vector<float> Parse(std::string contents, std::vector<vec3> analysispoints, float alpha_min, float r_max);
+    /**
+    * Creates a context that can compute all of the given metrics (e.g.
+    * "area", "volume", "minradial", "maxradial", "skyratio") on one device.
+    * Pipeline statistics are collected if pipeline_statistics is set and the
+    * device supports them. If pipeline_cache_path is given, the compiled
+    * pipelines are read from and written to that file, such that later
+    * contexts on the same device and driver start faster.
+    */
+    Context(std::vector<std::string> metrics, bool pipeline_statistics = true, std::string pipeline_cache_path = "");
+
+    std::vector<float> Parse(const std::string& contents, vec3_span analysispoints, float alpha_min, float r_max);
+
+    /**
+    * Computes the given metrics for every observation point. Every point is
+    * rendered once per render mode required by the metrics. The uploaded
+    * scene is kept, such that following calls on the same scenario skip
+    * parsing and uploading it. The points are read in place, they have to
+    * stay valid until the call returns.
+    *
+    * cancelled is polled before every observation point is submitted. Once it
+    * returns true, the submitted work is waited for and the call throws
+    * Cancelled, such that the context can be used for the next call.
+    */
+    std::map<std::string, std::vector<float>> Parse(const std::string& contents, vec3_span analysispoints, float alpha_min, float r_max, std::vector<std::string> metrics, std::function<bool()> cancelled = nullptr) override;
+
+    /**
+    * Returns the number of primitives generated by the tessellation stage for
+    * each observation point of the last call to Parse. The list is empty if
+    * the device does not support pipeline statistics queries.
+    */
+    std::vector<uint64_t> GetPrimitiveCounts() override;
+
+    /**
+    * Returns the pipeline statistics of all renders of the last call to
+    * Parse. The tessellation counters show the cost of alpha_max, the
+    * clipping and fragment counters that of the geometry in view.
+    */
+    std::map<std::string, uint64_t> GetPipelineStatistics() override;
+
+    /**
+    * Returns the host time of loading the scene ("load_scene") and of
+    * computing the observers ("observers") of the last call to Parse. If the
+    * queue supports timestamps, also the device time of each TimestampStage
+    * (see timestamp_stage_names), summed over all observers. Where the host
+    * time exceeds the device's, the observers wait for host synchronization.
+    */
+    std::map<std::string, double> GetStageTimes() override;
+
+    /**
+    * Returns the bytes of device memory allocated for the scene, images and
+    * buffers, including host visible staging memory.
+    */
+    uint64_t GetDeviceMemory() override;
 
     /**
     * Destroy the object. All vulkan objects are cleanly removed here.
@@ -58,24 +157,35 @@ namespace quavis {
     void InitializeVkDescriptorSetLayout();
     void InitializeVkGraphicsPipelineLayout();
     void InitializeVkComputePipelineLayout();
+    void InitializeVkPipelineCache();
+    void SavePipelineCache();
+    PipelineCacheHeader GetPipelineCacheHeader();
     void InitializeVkGraphicsPipeline();
     void InitializeVkComputePipeline();
+    void InitializeVkQueryPool();
     void InitializeVkMemory();
-    void InitializeVkGraphicsCommandBuffers();
+    void InitializeVkSceneMemory();
+    void DestroyVkSceneMemory();
+    void RecordGraphicsCommandBuffer(RenderMode mode);
     void InitializeVkComputeCommandBuffers();
     void InitializeVkImageLayouts();
-    void VkDraw();
-    void VkCompute();
-
-    void CreateBuffer(VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryflags, uint32_t size, VkBuffer* buffer, VkDeviceMemory* buffer_memory);
-    void CreateImage(VkFormat format, VkImageLayout layout, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags memoryflags, VkImage* image, VkDeviceMemory* image_memory);
+    void InitializeTiles(std::vector<std::vector<vec3>> features, float r_max);
+    void LoadScene(const std::string& contents, float r_max);
+    size_t GetMetricIndex(std::string name);
+    void CreateGraphicsPipeline(RenderMode mode, VkPipeline* pipeline);
+    void VkDraw(RenderMode mode);
+    void VkCompute(size_t metric);
+
+    void FreeMemory(const Allocation& memory);
+    void CreateBuffer(VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryflags, uint32_t size, VkBuffer* buffer, Allocation* buffer_memory);
+    void CreateImage(VkFormat format, VkImageLayout layout, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags memoryflags, VkImage* image, Allocation* image_memory);
     void CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags flags, VkImageView* imageview);
     void CreateGraphicsDescriptorSet(VkDescriptorSetLayout layouts[], VkDescriptorSet* descriptor_set);
     void UpdateGraphicsDescriptorSet(uint32_t size, VkBuffer buffer, VkDescriptorSet* descriptor_set);
     void CreateComputeDescriptorSets();
     void UpdateComputeDescriptorSets();
     void CreateFrameBuffer();
-    void CreateCommandPool(VkCommandPool* pool);
+    void CreateCommandPool(VkCommandPoolCreateFlags flags, VkCommandPool* pool);
     void CreateCommandBuffer(VkCommandPool pool, VkCommandBuffer* buffer);
 
     void TransformImageLayout(VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout, VkImageAspectFlags flags);
@@ -92,8 +202,20 @@ namespace quavis {
     void RetrieveComputeImage(uint32_t i);
     void* RetrieveResult();
     void ResetResult();
+    void RetrievePipelineStatistics(RenderMode mode, uint64_t statistics[PIPELINE_STATISTIC_COUNT]);
+    void BeginTimestamp(VkCommandBuffer commandbuffer, TimestampStage stage);
+    void EndTimestamp(VkCommandBuffer commandbuffer, TimestampStage stage);
+    void RetrieveTimestamp(TimestampStage stage);
+    void CalibrateTimestamps();
+
+    std::vector<Metric> metrics_ = {};
+    bool render_mode_required_[RENDER_MODE_COUNT] = {false, false};
+    bool conservative_rasterization_supported_ = false;
 
-    std::string shader_name_;
+    // the uploaded scene
+    bool scene_loaded_ = false;
+    std::string scene_contents_;
+    float scene_r_max_;
 
     // instance data
     VkInstance vk_instance_;
@@ -104,6 +226,26 @@ namespace quavis {
     // FENCES
     VkFence vk_compute_fence_;
 
+    // pipelines
+    std::string pipeline_cache_path_;
+    VkPipelineCache vk_pipeline_cache_ = VK_NULL_HANDLE;
+    size_t pipeline_cache_loaded_size_ = 0; // of the driver's data read from the file
+
+    // the memory of all buffers and images
+    std::unique_ptr<SubAllocator> allocator_;
+
+    // queries
+    bool pipeline_statistics_enabled_;
+    bool pipeline_statistics_supported_ = false; // and enabled
+    VkQueryPool vk_statistics_query_pool_ = VK_NULL_HANDLE;
+    std::vector<uint64_t> primitive_counts_ = {};
+    std::map<std::string, uint64_t> pipeline_statistics_ = {};
+    std::map<std::string, double> stage_times_ = {};
+    uint32_t timestamp_valid_bits_ = 0; // 0 if the queue does not support timestamps
+    float timestamp_period_ = 0; // nanoseconds per tick
+    VkQueryPool vk_timestamp_query_pool_ = VK_NULL_HANDLE;
+    double timestamp_offset_ = 0; // host microseconds (see Trace::Now) at timestamp 0
+
     // command pool
     VkCommandPool vk_graphics_command_pool_;
     VkCommandPool vk_compute_command_pool_;
@@ -119,16 +261,12 @@ namespace quavis {
     VkShaderModule vk_tessellation_evaluation_shader_;
     VkShaderModule vk_geoemtry_shader_;
     VkShaderModule vk_fragment_shader_;
-    VkShaderModule vk_compute_shader_;
-    VkShaderModule vk_compute_shader_2_;
 
     // pipeline
     VkRenderPass vk_render_pass_;
     VkPipelineLayout vk_graphics_pipeline_layout_;
     VkPipelineLayout vk_compute_pipeline_layout_;
-    VkPipeline vk_graphics_pipeline_;
-    VkPipeline vk_compute_pipeline_;
-    VkPipeline vk_compute_pipeline_2_;
+    VkPipeline vk_graphics_pipelines_[RENDER_MODE_COUNT] = {VK_NULL_HANDLE, VK_NULL_HANDLE};
 
     // descriptors
     VkDescriptorPool vk_descriptor_pool_;
@@ -149,15 +287,15 @@ namespace quavis {
     VkBuffer vk_compute_staging_buffer_;
     VkBuffer vk_compute_buffer_;
     VkBuffer vk_compute_tmp_buffer_;
-    VkDeviceMemory vk_vertex_staging_buffer_memory_;
-    VkDeviceMemory vk_vertex_buffer_memory_;
-    VkDeviceMemory vk_index_staging_buffer_memory_;
-    VkDeviceMemory vk_index_buffer_memory_;
-    VkDeviceMemory vk_uniform_staging_buffer_memory_;
-    VkDeviceMemory vk_uniform_buffer_memory_;
-    VkDeviceMemory vk_compute_staging_buffer_memory_;
-    VkDeviceMemory vk_compute_buffer_memory_;
-    VkDeviceMemory vk_compute_tmp_buffer_memory_;
+    Allocation vk_vertex_staging_buffer_memory_;
+    Allocation vk_vertex_buffer_memory_;
+    Allocation vk_index_staging_buffer_memory_;
+    Allocation vk_index_buffer_memory_;
+    Allocation vk_uniform_staging_buffer_memory_;
+    Allocation vk_uniform_buffer_memory_;
+    Allocation vk_compute_staging_buffer_memory_;
+    Allocation vk_compute_buffer_memory_;
+    Allocation vk_compute_tmp_buffer_memory_;
 
     // images
     VkImageView vk_color_imageview_;
@@ -168,11 +306,11 @@ namespace quavis {
     VkImage vk_compute_image_;
     VkImage vk_color_staging_image_;
     VkImage vk_depth_stencil_staging_image_;
-    VkDeviceMemory vk_color_image_memory_;
-    VkDeviceMemory vk_depth_stencil_image_memory_;
+    Allocation vk_color_image_memory_;
+    Allocation vk_depth_stencil_image_memory_;
     VkDeviceMemory vk_compute_image_memory_;
-    VkDeviceMemory vk_color_staging_image_memory_;
-    VkDeviceMemory vk_depth_stencil_staging_image_memory_;
+    Allocation vk_color_staging_image_memory_;
+    Allocation vk_depth_stencil_staging_image_memory_;
 
     // sampler
     VkSampler vk_sampler_;
@@ -181,9 +319,7 @@ namespace quavis {
     VkFramebuffer vk_graphics_framebuffer_;
 
     // command buffers
-    VkCommandBuffer vk_graphics_commandbuffer_;
-    VkCommandBuffer vk_compute_commandbuffer_;
-    VkCommandBuffer vk_compute_commandbuffer_2_;
+    VkCommandBuffer vk_graphics_commandbuffers_[RENDER_MODE_COUNT];
 
     // semaphores
     VkSemaphore vk_render_semaphore_;
@@ -204,17 +340,30 @@ namespace quavis {
     // rendering attributes
     const uint32_t render_width_ = 128;
     const uint32_t render_height_ = 64;
-    const size_t workgroups[3] = {128, 1, 1};
-    const size_t workgroups2[3] = {1, 1, 1};
+    const size_t workgroups[3] = {128, 1, 1}; // one work group per image column
     const size_t num_observation_points_x = 100;
     const VkFormat color_format_ = VK_FORMAT_R32G32_SFLOAT;
     const VkFormat depth_stencil_format_ = VK_FORMAT_D32_SFLOAT;
 
     const uint32_t compute_size_ = sizeof(float);
+    // counter of finished work groups followed by one partial result per group
+    const uint32_t compute_tmp_size_ = sizeof(uint32_t) + sizeof(float)*workgroups[0];
     unsigned int compute_default_value_ = 0;
 
     std::vector<Vertex> vertices_ = {};
     std::vector<uint32_t> indices_ = {};
+
+    // spatial tiling of the scene: each tile is a contiguous range in
+    // indices_; only tiles within r_max of the current observers are drawn.
+    const float tile_size_ = 0.5f; // minimum tile edge length relative to r_max
+    const uint32_t max_tiles_per_axis_ = 64;
+    // tiles further away than lod_distances_[l] * r_max are drawn with level of detail l+1
+    // (0: exact geometry, 1: decimated convex hulls of the building-like features,
+    // only for tiles where these have fewer triangles)
+    const std::vector<float> lod_distances_ = {0.25f};
+    tiling::Grid grid_;
+    std::vector<tiling::Tile> tiles_ = {};
+    std::vector<tiling::DrawRange> draw_ranges_ = {};
     UniformBufferObject uniform_ = {
       vec3 {0, 0, 0},
       10000,
@@ -0,0 +1,996 @@
+#ifndef QUAVIS_SERVICE_H
+#define QUAVIS_SERVICE_H
+
+#include <luciconnect/luciconnect.h>
+#include "quavis/vk/geometry/geometry.h"
+#include "quavis/quavis.h"
+#include "quavis/cpu/context.h"
+#include "quavis/jobqueue.h"
+#include "quavis/metrics.h"
+#include "quavis/trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <signal.h>
+
+namespace quavis {
+  class IsovistService;
+
+  /**
+  * Priority classes of runs, derived from their mode. Small interactive runs
+  * are computed before large background analyses.
+  */
+  enum IsovistPriority {
+    ISOVIST_PRIORITY_SCENARIO = 0, // "scenario" and "new": whole scenario grids
+    ISOVIST_PRIORITY_OBJECTS = 1,
+    ISOVIST_PRIORITY_POINTS = 2
+  };
+
+  inline IsovistPriority mode_priority(std::string mode) {
+    if (mode == "points")
+      return ISOVIST_PRIORITY_POINTS;
+    if (mode == "objects")
+      return ISOVIST_PRIORITY_OBJECTS;
+    return ISOVIST_PRIORITY_SCENARIO;
+  }
+
+  /**
+  * A run of one of the metric services between receiving it and answering it.
+  */
+  struct IsovistRequest {
+    IsovistService *service; // the service that received the run and answers it
+    int64_t client_call_id;
+    std::string metric;
+    std::shared_ptr<const std::vector<vec3>> points; // shared by all copies of the request
+    float r_max;
+    float alpha_max;
+    IsovistPriority priority;
+    std::chrono::steady_clock::time_point deadline; // time_point::max() if there is none
+
+    // the spans of a traced run, null if it is not traced
+    std::shared_ptr<Trace> trace;
+    std::string trace_path; // where the trace is written once the run's batch is finished
+    std::chrono::steady_clock::time_point received;
+    std::chrono::steady_clock::time_point queued; // when the scenario arrived or the run joined its batch
+  };
+
+  /**
+  * Runs on one scenario that are computed together: all of them are rendered
+  * in one pass per render mode and their results are scattered back.
+  */
+  struct IsovistBatch {
+    std::string scenario_id;
+    std::string geojson;
+    std::vector<IsovistRequest> requests;
+    std::chrono::steady_clock::time_point close_time; // runs may join until then
+    int priority; // the highest priority the batch has been queued with
+    bool scene_admitted = false;
+    bool closed = false; // a worker has taken the runs
+  };
+
+  /**
+  * Limits on the work admitted by an engine. A limit of 0 disables it.
+  */
+  struct IsovistLimits {
+    size_t max_queued_points; // points of all admitted runs that are not answered yet
+    size_t max_scene_bytes; // size of a scenario's GeoJSON
+    double max_gpu_seconds; // estimated computation time of the admitted points
+  };
+
+  /**
+  * Which runs are traced by an engine, see Trace. Runs with the input "trace"
+  * set are always traced.
+  */
+  struct IsovistTracing {
+    bool all_runs;
+    std::string directory; // where the trace of each run is written
+  };
+
+  /**
+  * The work admitted by an engine and not answered yet.
+  */
+  struct IsovistQueueDepth {
+    size_t runs;
+    size_t points;
+    double gpu_seconds; // estimated from the measured time per point
+  };
+
+  /**
+  * Runs of a batch that share one render (equal r_max and alpha_max), and
+  * the state of their computation between two chunks.
+  */
+  struct IsovistGroup {
+    std::shared_ptr<IsovistBatch> batch;
+    std::vector<IsovistRequest> requests;
+    std::shared_ptr<const std::vector<vec3>> points; // the points of all runs, the run's own if there is only one
+    std::vector<size_t> offsets; // the index of each run's first point in points
+    std::vector<std::string> metrics; // the union of the runs' metrics
+
+    // the values of each run computed so far, and whether it has been answered
+    std::vector<std::vector<float>> values;
+    std::vector<bool> finished;
+
+    size_t next_point = 0;
+    float alpha_max; // raised before the first chunk if the deadline would be missed
+    int priority; // the highest priority of the runs
+    std::chrono::steady_clock::time_point deadline; // the earliest deadline of the runs
+    std::map<std::string, double> timings = {}; // the backend's stage times, summed over the chunks
+    std::map<std::string, uint64_t> statistics = {}; // the backend's pipeline statistics, summed over the chunks
+    std::shared_ptr<Trace> trace; // the spans of the chunks, added to each traced run; null if no run is traced
+  };
+
+  /**
+  * The part shared by all metric services of a process: the worker threads,
+  * each with a single backend (e.g. a Context with its device, pipelines and
+  * uploaded scene) for all metrics, and the scenario requests in flight.
+  *
+  * Runs on the same scenario are coalesced: they share the scenario fetch and
+  * join the batch of that scenario during the coalescing window after the
+  * scenario has arrived. The batch is queued once the window has closed,
+  * with the highest priority of the runs that joined it.
+  *
+  * A batch is computed in chunks of chunk_size points. After each chunk, the
+  * runs that are not finished yet get a progress message with their values
+  * of that chunk.
+  *
+  * Every chunk is a job of its own, queued with the highest priority of the
+  * runs. Interactive runs thus preempt large analyses at chunk boundaries.
+  * If the points of a group would miss its earliest deadline at the rate
+  * measured so far, its tessellation is coarsened before the first chunk
+  * (alpha_max doubled up to max_alpha_max), such that all values of a run
+  * are computed with the alpha_max they are reported with.
+  *
+  * A traced run gets a timeline from its receipt to its result, including
+  * the chunks of its batch and the device's stages, as a Chrome trace file.
+  *
+  * The runs, points, queue depth and latencies are counted in a
+  * MetricsRegistry (see DescribeMetrics) for monitoring.
+  */
+  class IsovistEngine {
+  public:
+    /**
+    * Creates the backend of a worker for the given metrics, e.g. a Context
+    * or a cpu::Context.
+    */
+    typedef std::function<Backend *(std::vector<std::string> metrics)> BackendFactory;
+
+    IsovistEngine(std::vector<std::string> metrics, size_t num_workers, std::chrono::milliseconds coalesce_window, size_t chunk_size, IsovistLimits limits, IsovistTracing tracing, BackendFactory create_backend)
+      : metrics_(metrics),
+        create_backend_(create_backend),
+        coalesce_window_(coalesce_window),
+        chunk_size_(std::max<size_t>(chunk_size, 1)),
+        limits_(limits),
+        tracing_(tracing),
+        contexts_(std::max<size_t>(num_workers, 1)),
+        jobs_(num_workers) {
+      this->DescribeMetrics();
+    }
+
+    /**
+    * Admits a run if it fits into the limits, and reserves its points until
+    * it is answered. Otherwise returns false and the reason: runs that can
+    * never be admitted are rejected, others are deferred until the queue has
+    * drained.
+    */
+    bool Admit(const IsovistRequest& request, std::string& reason);
+
+    IsovistQueueDepth GetQueueDepth();
+
+    const IsovistTracing& GetTracing() const {
+      return this->tracing_;
+    }
+
+    MetricsRegistry& GetRegistry() {
+      return this->registry_;
+    }
+
+    /**
+    * Adds an admitted request for the given scenario. Returns true if the scenario has
+    * to be fetched with the returned callId, false if the request joined a
+    * pending fetch or a batch that has not been started yet.
+    */
+    bool AddRequest(std::string scenario_id, IsovistRequest request, int64_t& scenario_call_id);
+
+    /**
+    * Removes all requests waiting for the given scenario callId and releases
+    * them. Returns false if there are none.
+    */
+    bool TakeRequests(int64_t scenario_call_id, std::vector<IsovistRequest>& requests);
+
+    /**
+    * Opens a batch with all requests waiting for the given scenario callId
+    * and queues its computation. The results are sent by the requests'
+    * services. Returns false if no requests are waiting. Scenarios over the
+    * scene size limit fail all of their requests.
+    */
+    bool Compute(int64_t scenario_call_id, std::string geojson);
+
+    /**
+    * Cancels the given run of a service. A waiting run is dropped, a batch in
+    * progress skips the points of cancelled runs and stops once all of its
+    * runs are cancelled or answered. Cancelled runs are not answered.
+    */
+    void Cancel(IsovistService *service, int64_t client_call_id);
+
+  private:
+    typedef std::pair<IsovistService *, int64_t> RunKey;
+
+    void QueueBatch(std::shared_ptr<IsovistBatch> batch); // requires requests_mutex_
+    void Run(size_t worker, std::shared_ptr<IsovistBatch> batch);
+    void RunChunk(size_t worker, std::shared_ptr<IsovistGroup> group);
+    void FailGroup(std::shared_ptr<IsovistGroup> group, std::string what); // answers the unfinished runs with an error
+    void FinishGroup(std::shared_ptr<IsovistGroup> group);
+    bool IsCancelled(const IsovistRequest& request);
+    void Retire(const IsovistRequest& request); // before a run's final answer, it can no longer be cancelled
+    void Release(const IsovistRequest& request); // requires requests_mutex_
+    void DescribeMetrics();
+    void CountRun(const IsovistRequest& request, std::string status);
+    void UpdateQueueMetrics(); // requires requests_mutex_
+
+    const std::vector<std::string> metrics_;
+    const BackendFactory create_backend_;
+    const std::chrono::milliseconds coalesce_window_;
+    const size_t chunk_size_;
+    const float max_alpha_max_ = 1.5f; // the maximum alpha_max accepted by the services
+    const IsovistLimits limits_;
+    const IsovistTracing tracing_;
+
+    // requests waiting for their scenario, keyed by the scenario callId
+    std::map<int64_t, std::vector<IsovistRequest>> requests_ = {};
+    // scenario callIds of the scenarios being fetched, keyed by ScID
+    std::map<std::string, int64_t> fetching_ = {};
+    // batches that are queued but not started yet, keyed by ScID
+    std::map<std::string, std::shared_ptr<IsovistBatch>> open_batches_ = {};
+    // runs being computed and the ones among them that have been cancelled
+    std::set<RunKey> running_ = {};
+    std::set<RunKey> cancelled_ = {};
+    std::mutex requests_mutex_;
+    int64_t next_call_id_ = 1;
+
+    // admitted work, guarded by requests_mutex_
+    IsovistQueueDepth depth_ = {0, 0, 0};
+    double seconds_per_point_ = 0.001; // moving average over the computed chunks
+
+    MetricsRegistry registry_;
+    std::vector<std::unique_ptr<Backend>> contexts_;
+    JobQueue jobs_; // last member: workers are stopped before the contexts are destroyed
+  };
+
+  /**
+  * A luci service computing one isovist metric. Runs are answered by fetching
+  * the scenario and computing the metric on the engine's job queue, such that
+  * the luciconnect callback thread is never blocked by GPU work.
+  */
+  class IsovistService : public luciconnect::quaview::Service {
+  public:
+    /**
+    * Creates the service. metric selects the compute shader of the engine's
+    * contexts.
+    */
+    IsovistService(std::shared_ptr<luciconnect::Connection> connection, json register_message, std::string metric, std::string units, IsovistEngine *engine)
+      : luciconnect::quaview::Service(connection),
+        register_message_(register_message),
+        metric_(metric),
+        units_(units),
+        engine_(engine) {
+    }
+
+    void Run() override {
+      this->Connect();
+      this->Send([&]() { this->SendRun(0, "RemoteRegister", this->register_message_); });
+
+      // messages are handled by the connection's thread, sleep until stopped
+      std::unique_lock<std::mutex> lock(this->stop_mutex_);
+      this->stop_condition_.wait(lock, [this]() { return this->stopped_; });
+    }
+
+    /**
+    * Makes Run return. Queued jobs are finished when the engine is deleted.
+    */
+    void Stop() {
+      {
+        std::lock_guard<std::mutex> lock(this->stop_mutex_);
+        this->stopped_ = true;
+      }
+      this->stop_condition_.notify_all();
+    }
+
+    std::string GetName() override {
+      return register_message_["serviceName"];
+    }
+
+    std::string GetDescription() override {
+      return register_message_["description"];
+    }
+
+    std::string GetUnit() {
+      return register_message_["outputs"]["units"];
+    }
+
+    json GetInputs() override {
+      return register_message_["inputs"];
+    }
+
+    json GetConstraints() override {
+      return register_message_["constraints"];
+    }
+
+    bool SupportsPointMode() override {
+      return register_message_["constraints"]["mode"];
+    }
+
+    // TODO Move computation from HandleRun if its necessary
+    std::vector<float>
+    ComputeOnPoints(std::vector<luciconnect::vec3> scenario_triangles, std::vector<luciconnect::vec3> points,
+                    json inputs) override {
+      return *new std::vector<float>{};
+    }
+
+    /**
+    * Sends the values of a run to the client. alpha_max is the resolution
+    * they were computed with, which is coarser than requested if the run's
+    * deadline could not be met otherwise. timings are the seconds spent in
+    * each stage (see Backend::GetStageTimes) and statistics the pipeline
+    * statistics (if collected) of the batch of the run. trace_path is the
+    * file the run's trace is written to, empty if it is not traced.
+    */
+    void SendValues(int64_t call_id, std::vector<float>& values, float alpha_max, const std::map<std::string, double>& timings, const std::map<std::string, uint64_t>& statistics, std::string trace_path = "") {
+      trace::Span span("send result", "service", {{"callId", call_id}});
+      json result = {
+        {"units",     this->units_},
+        {"mode",      "points"},
+        {"alpha_max", alpha_max},
+        {"timings",   timings}
+      };
+      if (!statistics.empty())
+        result["statistics"] = statistics;
+      if (!trace_path.empty())
+        result["trace"] = trace_path;
+      float *raw = values.data();
+      luciconnect::Attachment atc{values.size() * sizeof(float), (const char *) raw, "Float32Array", "values"};
+      std::vector<luciconnect::Attachment *> atcs = {&atc};
+      this->Send([&]() { this->SendResult(call_id, result, atcs); });
+    }
+
+    /**
+    * Sends the values of the points [offset, offset + values.size()) of a
+    * run that is not finished yet to the client.
+    */
+    void SendPartialValues(int64_t call_id, int64_t percentage, size_t offset, std::vector<float>& values) {
+      trace::Span span("send progress", "service", {{"callId", call_id}, {"percentage", percentage}});
+      json intermediate_result = {
+        {"units",  this->units_},
+        {"mode",   "points"},
+        {"offset", offset},
+        {"count",  values.size()}
+      };
+      float *raw = values.data();
+      luciconnect::Attachment atc{values.size() * sizeof(float), (const char *) raw, "Float32Array", "values"};
+      std::vector<luciconnect::Attachment *> atcs = {&atc};
+      this->Send([&]() { this->SendProgress(call_id, percentage, atcs, intermediate_result); });
+    }
+
+    /**
+    * Tells the client that its run failed.
+    */
+    void SendFailure(int64_t call_id, std::string error) {
+      this->Send([&]() { this->SendError(call_id, error); });
+    }
+
+  protected:
+    const json register_message_;
+    const std::string metric_;
+    const std::string units_;
+
+    void HandleRun(int64_t callId, std::string serviceName, json inputs,
+                   std::vector<luciconnect::Attachment *> attachments) override {
+      std::shared_ptr<Trace> trace;
+      if (this->engine_->GetTracing().all_runs || (inputs.count("trace") > 0 && inputs["trace"].get<bool>()))
+        trace = std::make_shared<Trace>();
+      trace::Scope scope(trace.get());
+      trace::Span span("receive run", "service", {{"callId", callId}, {"metric", this->metric_}});
+
+      // the attachment is released after the callback, so the points are
+      // copied exactly once into a buffer shared until the run is answered
+      const quavis::vec3 *raw = (const quavis::vec3 *) attachments[0]->data;
+      IsovistRequest request;
+      request.service = this;
+      request.client_call_id = callId;
+      request.metric = this->metric_;
+      request.points = std::make_shared<const std::vector<quavis::vec3>>(raw, raw + attachments[0]->size / sizeof(quavis::vec3));
+      request.r_max = inputs["r_max"];
+      request.alpha_max = inputs["alpha_max"];
+      request.priority = mode_priority(inputs.count("mode") > 0 ? inputs["mode"].get<std::string>() : "points");
+      request.deadline = std::chrono::steady_clock::time_point::max();
+      if (inputs.count("deadline") > 0 && inputs["deadline"].get<float>() > 0) {
+        std::chrono::duration<float> deadline(inputs["deadline"].get<float>());
+        request.deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(deadline);
+      }
+      request.trace = trace;
+      if (trace)
+        request.trace_path = this->engine_->GetTracing().directory + "/quavis-" + this->metric_ + "-" + std::to_string(callId) + ".json";
+      request.received = std::chrono::steady_clock::now();
+      request.queued = request.received;
+
+      std::string reason;
+      if (!this->engine_->Admit(request, reason)) {
+        std::cout << "WARNING: " << reason << std::endl;
+        this->SendFailure(callId, reason);
+        return;
+      }
+
+      // runs on the same scenario share one fetch and one batch
+      int64_t scenario_call_id;
+      if (this->engine_->AddRequest(inputs["ScID"].dump(), request, scenario_call_id))
+        this->Send([&]() { this->SendRun(scenario_call_id, "scenario.geojson.Get", {{"ScID", inputs["ScID"]}}); });
+    };
+
+    void HandleResult(int64_t callId, json result, std::vector<luciconnect::Attachment *> attachments) override {
+      if (result.count("registeredName") > 0) {
+        // registered
+      } else if (result.count("geometry_output") > 0 && this->engine_->Compute(callId, result["geometry_output"]["geometry"].dump())) {
+        // got scenario, the metrics are computed on the workers
+      } else {
+        std::cout << result << std::endl;
+      }
+    };
+
+    void HandleCancel(int64_t callId) override {
+      this->engine_->Cancel(this, callId);
+    };
+
+    void HandleProgress(int64_t callId, int64_t percentage, std::vector<luciconnect::Attachment *> attachments,
+                        json intermediateResult) override {};
+
+    void HandleError(int64_t callId, std::string error) override {
+      std::cout << error << std::endl;
+
+      // the scenario of some requests could not be fetched
+      std::vector<IsovistRequest> requests;
+      if (this->engine_->TakeRequests(callId, requests))
+        for (IsovistRequest& request : requests)
+          request.service->SendFailure(request.client_call_id, error);
+    };
+
+    /**
+    * Messages are sent from the callback thread and the workers, so sending
+    * is serialized.
+    */
+    void Send(std::function<void()> send) {
+      std::lock_guard<std::mutex> lock(this->send_mutex_);
+      send();
+    }
+
+  private:
+    IsovistEngine *engine_; // outlives the service's jobs, is deleted before the services
+
+    std::mutex send_mutex_;
+    std::mutex stop_mutex_;
+    std::condition_variable stop_condition_;
+    bool stopped_ = false;
+  };
+
+  inline bool IsovistEngine::Admit(const IsovistRequest& request, std::string& reason) {
+    std::lock_guard<std::mutex> lock(this->requests_mutex_);
+    size_t points = request.points->size();
+    double gpu_seconds = points * this->seconds_per_point_;
+    if (this->limits_.max_queued_points > 0 && points > this->limits_.max_queued_points) {
+      reason = "Rejected: " + std::to_string(points) + " points exceed the limit of " + std::to_string(this->limits_.max_queued_points) + " points per run.";
+      this->CountRun(request, "rejected");
+      return false;
+    }
+    if (this->limits_.max_gpu_seconds > 0 && gpu_seconds > this->limits_.max_gpu_seconds) {
+      reason = "Rejected: the run would take about " + std::to_string((int64_t)gpu_seconds) + " s, the limit is " + std::to_string((int64_t)this->limits_.max_gpu_seconds) + " s.";
+      this->CountRun(request, "rejected");
+      return false;
+    }
+    if ((this->limits_.max_queued_points > 0 && this->depth_.points + points > this->limits_.max_queued_points) ||
+        (this->limits_.max_gpu_seconds > 0 && (this->depth_.points + points) * this->seconds_per_point_ > this->limits_.max_gpu_seconds)) {
+      reason = "Deferred: " + std::to_string(this->depth_.runs) + " runs with " + std::to_string(this->depth_.points) + " points are queued, retry later.";
+      this->CountRun(request, "deferred");
+      return false;
+    }
+
+    this->depth_.runs++;
+    this->depth_.points += points;
+    this->CountRun(request, "admitted");
+    this->UpdateQueueMetrics();
+    return true;
+  }
+
+  inline IsovistQueueDepth IsovistEngine::GetQueueDepth() {
+    std::lock_guard<std::mutex> lock(this->requests_mutex_);
+    IsovistQueueDepth depth = this->depth_;
+    depth.gpu_seconds = depth.points * this->seconds_per_point_;
+    return depth;
+  }
+
+  inline void IsovistEngine::Release(const IsovistRequest& request) {
+    this->depth_.runs--;
+    this->depth_.points -= request.points->size();
+    this->UpdateQueueMetrics();
+  }
+
+  inline void IsovistEngine::DescribeMetrics() {
+    MetricsRegistry& r = this->registry_;
+    r.Describe("quavis_runs_total", METRIC_COUNTER, "Runs by metric and status (admitted, rejected, deferred, answered, failed or cancelled).");
+    r.Describe("quavis_points_total", METRIC_COUNTER, "Points computed.");
+    r.Describe("quavis_points_per_second", METRIC_GAUGE, "Points computed per second by a worker in its last chunk.");
+    r.Describe("quavis_queued_runs", METRIC_GAUGE, "Runs admitted and not answered yet.");
+    r.Describe("quavis_queued_points", METRIC_GAUGE, "Points of the runs admitted and not answered yet.");
+    r.Describe("quavis_queued_gpu_seconds", METRIC_GAUGE, "Estimated computation time of the queued points.");
+    r.Describe("quavis_device_memory_bytes", METRIC_GAUGE, "Device memory allocated by the backend of a worker.");
+    r.Describe("quavis_scenario_fetch_seconds", METRIC_HISTOGRAM, "Time from receiving a run until its scenario arrived.", latency_buckets);
+    r.Describe("quavis_scenario_bytes", METRIC_GAUGE, "Size of the last scenario fetched.");
+    r.Describe("quavis_chunk_seconds", METRIC_HISTOGRAM, "Time of computing a chunk of points.", latency_buckets);
+    r.Describe("quavis_stage_seconds", METRIC_HISTOGRAM, "Time of each stage of the backend per chunk. load_scene covers parsing, triangulating and uploading a scenario that is not cached yet.", latency_buckets);
+    r.Describe("quavis_run_seconds", METRIC_HISTOGRAM, "Time from receiving a run until it is answered.", latency_buckets);
+  }
+
+  inline void IsovistEngine::CountRun(const IsovistRequest& request, std::string status) {
+    this->registry_.Add("quavis_runs_total", 1, {{"metric", request.metric}, {"status", status}});
+    if (status == "answered") {
+      std::chrono::duration<double> latency = std::chrono::steady_clock::now() - request.received;
+      this->registry_.Observe("quavis_run_seconds", latency.count(), {{"metric", request.metric}});
+    }
+  }
+
+  inline void IsovistEngine::UpdateQueueMetrics() {
+    this->registry_.Set("quavis_queued_runs", this->depth_.runs);
+    this->registry_.Set("quavis_queued_points", this->depth_.points);
+    this->registry_.Set("quavis_queued_gpu_seconds", this->depth_.points * this->seconds_per_point_);
+  }
+
+  inline bool IsovistEngine::AddRequest(std::string scenario_id, IsovistRequest request, int64_t& scenario_call_id) {
+    std::lock_guard<std::mutex> lock(this->requests_mutex_);
+    auto fetch = this->fetching_.find(scenario_id);
+    if (fetch != this->fetching_.end()) {
+      this->requests_[fetch->second].push_back(request);
+      return false;
+    }
+
+    auto batch = this->open_batches_.find(scenario_id);
+    if (batch != this->open_batches_.end()) {
+      request.queued = std::chrono::steady_clock::now();
+      batch->second->requests.push_back(request);
+
+      // queue the batch again, the worker that comes first closes it
+      if (request.priority > batch->second->priority) {
+        batch->second->priority = request.priority;
+        this->QueueBatch(batch->second);
+      }
+      return false;
+    }
+
+    scenario_call_id = this->next_call_id_++;
+    this->fetching_[scenario_id] = scenario_call_id;
+    this->requests_[scenario_call_id].push_back(request);
+    return true;
+  }
+
+  inline bool IsovistEngine::TakeRequests(int64_t scenario_call_id, std::vector<IsovistRequest>& requests) {
+    std::lock_guard<std::mutex> lock(this->requests_mutex_);
+    auto it = this->requests_.find(scenario_call_id);
+    if (it == this->requests_.end())
+      return false;
+    requests = it->second;
+    this->requests_.erase(it);
+    for (IsovistRequest& request : requests) {
+      this->Release(request);
+      this->CountRun(request, "failed");
+    }
+
+    for (auto fetch = this->fetching_.begin(); fetch != this->fetching_.end(); fetch++) {
+      if (fetch->second == scenario_call_id) {
+        this->fetching_.erase(fetch);
+        break;
+      }
+    }
+    return true;
+  }
+
+  inline bool IsovistEngine::Compute(int64_t scenario_call_id, std::string geojson) {
+    std::shared_ptr<IsovistBatch> batch = std::make_shared<IsovistBatch>();
+    batch->geojson = geojson;
+    batch->close_time = std::chrono::steady_clock::now() + this->coalesce_window_;
+    {
+      std::lock_guard<std::mutex> lock(this->requests_mutex_);
+      for (auto fetch = this->fetching_.begin(); fetch != this->fetching_.end(); fetch++) {
+        if (fetch->second == scenario_call_id) {
+          batch->scenario_id = fetch->first;
+          this->fetching_.erase(fetch);
+          break;
+        }
+      }
+
+      // all runs may have been cancelled while fetching
+      auto it = this->requests_.find(scenario_call_id);
+      if (it == this->requests_.end())
+        return false;
+      batch->requests = it->second;
+      this->requests_.erase(it);
+      for (IsovistRequest& request : batch->requests) {
+        request.queued = std::chrono::steady_clock::now();
+        this->registry_.Observe("quavis_scenario_fetch_seconds", std::chrono::duration<double>(request.queued - request.received).count());
+        if (request.trace)
+          request.trace->Complete("fetch scenario", "service", request.received, request.queued, {{"bytes", geojson.size()}});
+      }
+
+      this->registry_.Set("quavis_scenario_bytes", geojson.size());
+      if (this->limits_.max_scene_bytes > 0 && geojson.size() > this->limits_.max_scene_bytes) {
+        for (IsovistRequest& request : batch->requests) {
+          this->Release(request);
+          this->CountRun(request, "failed");
+        }
+      } else {
+        batch->priority = ISOVIST_PRIORITY_SCENARIO;
+        for (IsovistRequest& request : batch->requests)
+          batch->priority = std::max<int>(batch->priority, request.priority);
+        this->open_batches_[batch->scenario_id] = batch;
+        batch->scene_admitted = true;
+        this->QueueBatch(batch);
+      }
+    }
+
+    if (!batch->scene_admitted) {
+      std::string reason = "Rejected: the scenario has " + std::to_string(geojson.size()) + " bytes, the limit is " + std::to_string(this->limits_.max_scene_bytes) + " bytes.";
+      std::cout << "WARNING: " << reason << std::endl;
+      for (IsovistRequest& request : batch->requests)
+        request.service->SendFailure(request.client_call_id, reason);
+    }
+    return true;
+  }
+
+  inline void IsovistEngine::QueueBatch(std::shared_ptr<IsovistBatch> batch) {
+    this->jobs_.Push([this, batch](size_t worker) {
+      this->Run(worker, batch);
+    }, batch->priority, batch->close_time);
+  }
+
+  inline void IsovistEngine::Cancel(IsovistService *service, int64_t client_call_id) {
+    std::lock_guard<std::mutex> lock(this->requests_mutex_);
+    auto is_run = [service, client_call_id](const IsovistRequest& request) {
+      return request.service == service && request.client_call_id == client_call_id;
+    };
+
+    auto drop = [this, &is_run](std::vector<IsovistRequest>& requests) {
+      auto dropped = std::stable_partition(requests.begin(), requests.end(), [&is_run](const IsovistRequest& request) {
+        return !is_run(request);
+      });
+      for (auto it = dropped; it != requests.end(); it++) {
+        this->Release(*it);
+        this->CountRun(*it, "cancelled");
+      }
+      requests.erase(dropped, requests.end());
+    };
+
+    // waiting for the scenario
+    for (auto it = this->requests_.begin(); it != this->requests_.end();) {
+      std::vector<IsovistRequest>& requests = it->second;
+      drop(requests);
+      if (requests.empty())
+        it = this->requests_.erase(it);
+      else
+        it++;
+    }
+
+    // waiting for a worker
+    for (auto& batch : this->open_batches_)
+      drop(batch.second->requests);
+
+    // being computed
+    RunKey key = std::make_pair(service, client_call_id);
+    if (this->running_.count(key) > 0)
+      this->cancelled_.insert(key);
+  }
+
+  inline void IsovistEngine::Run(size_t worker, std::shared_ptr<IsovistBatch> batch) {
+    // close the batch, later runs fetch the scenario again
+    std::vector<IsovistRequest> requests;
+    {
+      std::lock_guard<std::mutex> lock(this->requests_mutex_);
+      if (batch->closed)
+        return;
+      batch->closed = true;
+      auto it = this->open_batches_.find(batch->scenario_id);
+      if (it != this->open_batches_.end() && it->second == batch)
+        this->open_batches_.erase(it);
+      requests = batch->requests;
+      for (IsovistRequest& request : requests)
+        this->running_.insert(std::make_pair(request.service, request.client_call_id));
+    }
+    if (requests.empty())
+      return;
+
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    for (IsovistRequest& request : requests)
+      if (request.trace)
+        request.trace->Complete("queued", "service", request.queued, started, {{"runs", requests.size()}});
+
+    // runs can only share a render if they use the same parameters
+    std::map<std::pair<float, float>, std::shared_ptr<IsovistGroup>> groups;
+    for (IsovistRequest& request : requests) {
+      std::shared_ptr<IsovistGroup>& group = groups[std::make_pair(request.r_max, request.alpha_max)];
+      if (!group) {
+        group = std::make_shared<IsovistGroup>();
+        group->batch = batch;
+        group->alpha_max = request.alpha_max;
+        group->priority = request.priority;
+        group->deadline = request.deadline;
+      }
+
+      // merge the metrics of all runs
+      group->requests.push_back(request);
+      if (std::find(group->metrics.begin(), group->metrics.end(), request.metric) == group->metrics.end())
+        group->metrics.push_back(request.metric);
+      group->priority = std::max<int>(group->priority, request.priority);
+      group->deadline = std::min(group->deadline, request.deadline);
+      if (request.trace && !group->trace)
+        group->trace = std::make_shared<Trace>();
+    }
+
+    IsovistQueueDepth depth = this->GetQueueDepth();
+    std::cout << "INFO: " << "Computing " << requests.size() << " runs in " << groups.size() << " batches, "
+              << depth.runs << " runs with " << depth.points << " points (about " << depth.gpu_seconds << " s) queued" << std::endl;
+    for (auto& it : groups) {
+      std::shared_ptr<IsovistGroup> group = it.second;
+
+      // merge the points of all runs, a single run is computed in place
+      if (group->requests.size() == 1) {
+        group->offsets.push_back(0);
+        group->points = group->requests[0].points;
+      } else {
+        std::shared_ptr<std::vector<vec3>> points = std::make_shared<std::vector<vec3>>();
+        for (IsovistRequest& request : group->requests) {
+          group->offsets.push_back(points->size());
+          points->insert(points->end(), request.points->begin(), request.points->end());
+        }
+        group->points = points;
+      }
+
+      group->values = std::vector<std::vector<float>>(group->requests.size());
+      group->finished = std::vector<bool>(group->requests.size(), false);
+      for (size_t i = 0; i < group->requests.size(); i++) {
+        IsovistRequest& request = group->requests[i];
+        if (request.points->empty() && !this->IsCancelled(request)) {
+          this->Retire(request);
+          request.service->SendValues(request.client_call_id, group->values[i], group->alpha_max, group->timings, group->statistics, request.trace_path);
+          this->CountRun(request, "answered");
+          group->finished[i] = true;
+        }
+      }
+
+      if (group->points->empty())
+        this->FinishGroup(group);
+      else
+        this->jobs_.Push([this, group](size_t worker) {
+          this->RunChunk(worker, group);
+        }, group->priority);
+    }
+  }
+
+  inline void IsovistEngine::RunChunk(size_t worker, std::shared_ptr<IsovistGroup> group) {
+    std::vector<IsovistRequest>& requests = group->requests;
+    auto live = [this, group](size_t i) {
+      return !group->finished[i] && !this->IsCancelled(group->requests[i]);
+    };
+    auto all_cancelled = [&live, &requests]() {
+      for (size_t i = 0; i < requests.size(); i++)
+        if (live(i))
+          return false;
+      return true;
+    };
+
+    // skip the points of cancelled runs up to the first live one
+    size_t begin = group->points->size();
+    for (size_t i = 0; i < requests.size(); i++) {
+      if (live(i) && group->offsets[i] + requests[i].points->size() > group->next_point)
+        begin = std::min(begin, std::max(group->next_point, group->offsets[i]));
+    }
+    if (begin == group->points->size()) {
+      std::cout << "INFO: " << "Cancelled " << requests.size() << " runs" << std::endl;
+      this->FinishGroup(group);
+      return;
+    }
+    size_t end = std::min(begin + this->chunk_size_, group->points->size());
+    trace::Scope scope(group->trace.get());
+    trace::Span span("observer batch", "service", {{"first", begin}, {"count", end - begin}, {"worker", worker}});
+
+    // degrade the resolution once before the first chunk, such that all
+    // values of a run share one alpha_max. The time per point is assumed to
+    // shrink in proportion to alpha_max.
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (group->next_point == 0 && group->deadline != std::chrono::steady_clock::time_point::max()) {
+      double seconds;
+      {
+        std::lock_guard<std::mutex> lock(this->requests_mutex_);
+        seconds = group->points->size() * this->seconds_per_point_;
+      }
+      float alpha_max = group->alpha_max;
+      while (alpha_max < this->max_alpha_max_ && now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds)) > group->deadline) {
+        float coarser = std::min(2 * alpha_max, this->max_alpha_max_);
+        seconds *= alpha_max / coarser;
+        alpha_max = coarser;
+      }
+      if (alpha_max != group->alpha_max) {
+        group->alpha_max = alpha_max;
+        std::cout << "INFO: " << "Deadline would be missed, using alpha_max " << group->alpha_max << std::endl;
+      }
+    }
+
+    try {
+      // every worker keeps its own context, they are not thread-safe
+      if (!this->contexts_[worker])
+        this->contexts_[worker] = std::unique_ptr<Backend>(this->create_backend_(this->metrics_));
+
+      vec3_span chunk = vec3_span(*group->points).subspan(begin, end - begin);
+      std::map<std::string, std::vector<float>> results = this->contexts_[worker]->Parse(group->batch->geojson, chunk, group->alpha_max, requests[0].r_max, group->metrics, all_cancelled);
+      std::chrono::steady_clock::duration chunk_time = std::chrono::steady_clock::now() - now;
+      for (auto& stage : this->contexts_[worker]->GetStageTimes()) {
+        group->timings[stage.first] += stage.second;
+        this->registry_.Observe("quavis_stage_seconds", stage.second, {{"stage", stage.first}});
+      }
+      this->registry_.Add("quavis_points_total", end - begin);
+      this->registry_.Observe("quavis_chunk_seconds", std::chrono::duration<double>(chunk_time).count());
+      this->registry_.Set("quavis_points_per_second", (end - begin) / std::chrono::duration<double>(chunk_time).count(), {{"worker", std::to_string(worker)}});
+      this->registry_.Set("quavis_device_memory_bytes", this->contexts_[worker]->GetDeviceMemory(), {{"worker", std::to_string(worker)}});
+      for (auto& statistic : this->contexts_[worker]->GetPipelineStatistics())
+        group->statistics[statistic.first] += statistic.second;
+      {
+        std::lock_guard<std::mutex> lock(this->requests_mutex_);
+        double seconds_per_point = std::chrono::duration<double>(chunk_time).count() / (end - begin);
+        this->seconds_per_point_ = 0.9 * this->seconds_per_point_ + 0.1 * seconds_per_point;
+      }
+
+      // scatter the results back to the runs overlapping the chunk
+      for (size_t i = 0; i < requests.size(); i++) {
+        size_t first = std::max(begin, group->offsets[i]);
+        size_t last = std::min(end, group->offsets[i] + requests[i].points->size());
+        if (first >= last || this->IsCancelled(requests[i]))
+          continue;
+
+        std::vector<float>& result = results[requests[i].metric];
+        std::vector<float> partial(result.begin() + (first - begin), result.begin() + (last - begin));
+        std::vector<float>& values = group->values[i];
+        values.insert(values.end(), partial.begin(), partial.end());
+        if (values.size() == requests[i].points->size()) {
+          this->Retire(requests[i]);
+          requests[i].service->SendValues(requests[i].client_call_id, values, group->alpha_max, group->timings, group->statistics, requests[i].trace_path);
+          this->CountRun(requests[i], "answered");
+          std::vector<float>().swap(values);
+          group->finished[i] = true;
+        } else {
+          int64_t percentage = (int64_t)(100 * values.size() / requests[i].points->size());
+          requests[i].service->SendPartialValues(requests[i].client_call_id, percentage, first - group->offsets[i], partial);
+        }
+      }
+    }
+    catch (const Cancelled&) {
+      std::cout << "INFO: " << "Cancelled " << requests.size() << " runs" << std::endl;
+      this->FinishGroup(group);
+      return;
+    }
+    catch (const char *what) {
+      this->FailGroup(group, what);
+      this->FinishGroup(group);
+      return;
+    }
+    catch (const std::exception& e) {
+      // e.g. a malformed scenario or running out of memory, the worker
+      // goes on with the next job
+      this->FailGroup(group, e.what());
+      this->FinishGroup(group);
+      return;
+    }
+
+    // requeue the rest, such that runs of higher priority can go first
+    group->next_point = end;
+    if (end < group->points->size())
+      this->jobs_.Push([this, group](size_t worker) {
+        this->RunChunk(worker, group);
+      }, group->priority);
+    else
+      this->FinishGroup(group);
+  }
+
+  inline void IsovistEngine::FailGroup(std::shared_ptr<IsovistGroup> group, std::string what) {
+    std::cout << "WARNING: " << "Computation failed: " << what << std::endl;
+    for (size_t i = 0; i < group->requests.size(); i++) {
+      IsovistRequest& request = group->requests[i];
+      if (!group->finished[i] && !this->IsCancelled(request)) {
+        this->Retire(request);
+        request.service->SendFailure(request.client_call_id, what);
+        this->CountRun(request, "failed");
+        group->finished[i] = true;
+      }
+    }
+  }
+
+  inline void IsovistEngine::FinishGroup(std::shared_ptr<IsovistGroup> group) {
+    if (!group->timings.empty()) {
+      std::cout << "INFO: " << "Timings of " << group->requests.size() << " runs with " << group->next_point << " points:";
+      for (auto& stage : group->timings)
+        std::cout << " " << stage.first << " " << stage.second << " s";
+      std::cout << std::endl;
+    }
+    if (!group->statistics.empty()) {
+      std::cout << "INFO: " << "Pipeline statistics of " << group->requests.size() << " runs at alpha_max " << group->alpha_max << ":";
+      for (auto& statistic : group->statistics)
+        std::cout << " " << statistic.first << " " << statistic.second;
+      std::cout << std::endl;
+    }
+    if (group->trace) {
+      for (IsovistRequest& request : group->requests) {
+        if (!request.trace)
+          continue;
+        request.trace->Append(*group->trace);
+        if (request.trace->Write(request.trace_path))
+          std::cout << "INFO: " << "Wrote the trace of run " << request.client_call_id << " to " << request.trace_path << std::endl;
+        else
+          std::cout << "WARNING: " << "Could not write the trace " << request.trace_path << std::endl;
+      }
+    }
+
+    // answered and failed runs have been retired already
+    std::lock_guard<std::mutex> lock(this->requests_mutex_);
+    for (size_t i = 0; i < group->requests.size(); i++) {
+      if (group->finished[i])
+        continue;
+      IsovistRequest& request = group->requests[i];
+      RunKey key = std::make_pair(request.service, request.client_call_id);
+      this->running_.erase(key);
+      if (this->cancelled_.erase(key) > 0)
+        this->CountRun(request, "cancelled");
+      this->Release(request);
+    }
+  }
+
+  inline void IsovistEngine::Retire(const IsovistRequest& request) {
+    std::lock_guard<std::mutex> lock(this->requests_mutex_);
+    RunKey key = std::make_pair(request.service, request.client_call_id);
+    this->running_.erase(key);
+    this->cancelled_.erase(key);
+    this->Release(request);
+  }
+
+  inline bool IsovistEngine::IsCancelled(const IsovistRequest& request) {
+    std::lock_guard<std::mutex> lock(this->requests_mutex_);
+    return this->cancelled_.count(std::make_pair(request.service, request.client_call_id)) > 0;
+  }
+
+  /**
+  * Blocks SIGINT and SIGTERM in the calling thread and all threads it starts
+  * afterwards. Call this before creating the services (and their workers).
+  */
+  inline sigset_t block_stop_signals() {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    return signals;
+  }
+
+  /**
+  * Stops the services from a dedicated thread once one of the given
+  * (blocked) signals arrives.
+  */
+  inline void stop_on_signal(sigset_t signals, std::vector<IsovistService *> services) {
+    std::thread([signals, services]() {
+      int signal;
+      sigwait(&signals, &signal);
+      std::cout << "INFO: " << "Received signal " << signal << ", stopping the services" << std::endl;
+      for (IsovistService *service : services)
+        service->Stop();
+    }).detach();
+  }
+}
+
+#endif // QUAVIS_SERVICE_H
@@ -0,0 +1,167 @@
+#ifndef QUAVIS_TRACE_H
+#define QUAVIS_TRACE_H
+
+#include "json.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+namespace quavis {
+  /**
+  * The spans of the work on a run in the Chrome trace event format, which
+  * chrome://tracing and Perfetto display as a timeline per thread. Host
+  * threads are numbered from 1, the device's work is shown as thread 0 on
+  * the host's clock. Spans may be added from any thread.
+  */
+  class Trace {
+  public:
+    static const int DEVICE_THREAD = 0;
+
+    Trace() {
+      // the epoch precedes all spans of the trace
+      Now();
+    }
+
+    /**
+    * Microseconds since the first trace of this process was created, the
+    * time base of all traces.
+    */
+    static double Now() {
+      return ToMicroseconds(std::chrono::steady_clock::now());
+    }
+
+    static double ToMicroseconds(std::chrono::steady_clock::time_point time) {
+      static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+      return std::chrono::duration<double, std::micro>(time - epoch).count();
+    }
+
+    /**
+    * The number of the calling thread in traces.
+    */
+    static int ThreadId() {
+      static std::atomic<int> next_id(DEVICE_THREAD + 1);
+      static thread_local int id = next_id++;
+      return id;
+    }
+
+    void Complete(std::string name, std::string category, double begin, double end, nlohmann::json args = nlohmann::json::object(), int thread = ThreadId()) {
+      nlohmann::json event = {
+        {"name", name},
+        {"cat",  category},
+        {"ph",   "X"},
+        {"ts",   begin},
+        {"dur",  end - begin},
+        {"pid",  getpid()},
+        {"tid",  thread},
+        {"args", args}
+      };
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      this->events_.push_back(event);
+    }
+
+    void Complete(std::string name, std::string category, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end, nlohmann::json args = nlohmann::json::object()) {
+      this->Complete(name, category, ToMicroseconds(begin), ToMicroseconds(end), args);
+    }
+
+    /**
+    * Adds the spans of another trace, e.g. those of a batch to each of its
+    * runs.
+    */
+    void Append(Trace& other) {
+      std::vector<nlohmann::json> events;
+      {
+        std::lock_guard<std::mutex> lock(other.mutex_);
+        events = other.events_;
+      }
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      this->events_.insert(this->events_.end(), events.begin(), events.end());
+    }
+
+    /**
+    * Writes the trace as a JSON file. Returns false if it could not be
+    * written.
+    */
+    bool Write(std::string path) {
+      nlohmann::json events = nlohmann::json::array();
+      events.push_back({
+        {"name", "thread_name"},
+        {"ph",   "M"},
+        {"pid",  getpid()},
+        {"tid",  DEVICE_THREAD},
+        {"args", {{"name", "device"}}}
+      });
+      {
+        std::lock_guard<std::mutex> lock(this->mutex_);
+        for (nlohmann::json& event : this->events_)
+          events.push_back(event);
+      }
+
+      std::ofstream file(path);
+      file << nlohmann::json({{"traceEvents", events}, {"displayTimeUnit", "ms"}}).dump() << std::endl;
+      return file.good();
+    }
+
+  private:
+    std::mutex mutex_;
+    std::vector<nlohmann::json> events_ = {};
+  };
+
+  namespace trace {
+    /**
+    * The trace spans of the calling thread are added to, null if it is not
+    * traced.
+    */
+    inline Trace*& current() {
+      static thread_local Trace *trace = nullptr;
+      return trace;
+    }
+
+    /**
+    * Traces the calling thread into the given trace (nothing if null) until
+    * the scope ends.
+    */
+    class Scope {
+    public:
+      Scope(Trace *trace) : previous_(current()) {
+        current() = trace;
+      }
+
+      ~Scope() {
+        current() = this->previous_;
+      }
+
+    private:
+      Trace *previous_;
+    };
+
+    /**
+    * A span from its construction to the end of its scope, added to the
+    * calling thread's trace.
+    */
+    class Span {
+    public:
+      Span(std::string name, std::string category, nlohmann::json args = nlohmann::json::object())
+        : trace_(current()), name_(name), category_(category), args_(args), begin_(trace_ ? Trace::Now() : 0) {
+      }
+
+      ~Span() {
+        if (this->trace_)
+          this->trace_->Complete(this->name_, this->category_, this->begin_, Trace::Now(), this->args_);
+      }
+
+    private:
+      Trace *trace_;
+      std::string name_;
+      std::string category_;
+      nlohmann::json args_;
+      double begin_;
+    };
+  }
+}
+
+#endif // QUAVIS_TRACE_H
@@ -6,7 +6,7 @@
 
 namespace quavis {
   namespace debug {
-    extern bool handleVkResult(VkResult vkResult) {
+    inline bool handleVkResult(VkResult vkResult) {
       if (vkResult != 0) {
         std::cout << vkResult << std::endl;
         throw "An error occurred in the gpu initialization:";
@@ -4,6 +4,7 @@
 #include "json.hpp"
 #include "quavis/vk/geometry/geometry.h"
 #include "quavis/vk/geometry/triangulation.hpp"
+#include "quavis/trace.h"
 
 #include <string>
 
@@ -11,7 +12,7 @@ using json = nlohmann::json;
 
 namespace quavis {
   namespace geojson {
-    std::vector<vec3> triangulate_polygon(json js) {
+    inline std::vector<vec3> triangulate_polygon(json js) {
       std::vector<vec3> points = {};
       std::vector<vec3> triangles = {};
 
@@ -23,7 +24,7 @@ namespace quavis {
       return triangulation::triangulate(points);
     }
 
-    std::vector<vec3> get_triangles(json js) {
+    inline std::vector<vec3> get_triangles(json js) {
       std::vector<vec3> triangles = {};
 
       if (js.count("type") > 0) {
@@ -52,11 +53,45 @@ namespace quavis {
       return triangles;
     }
 
-    std::vector<vec3> parse(std::string text) {
-      json js = json::parse(text);
+    inline std::vector<vec3> parse(std::string text) {
+      json js;
+      {
+        trace::Span span("parse json", "scene");
+        js = json::parse(text);
+      }
+      trace::Span span("triangulate", "scene");
       std::vector<vec3> triangles = get_triangles(js);
       return triangles;
     }
+
+    /**
+     * Parses the text and keeps the triangles of each feature (e.g. building)
+     * together. A document without features is returned as a single feature.
+     */
+    inline std::vector<std::vector<vec3>> parse_features(std::string text) {
+      json js;
+      {
+        trace::Span span("parse json", "scene");
+        js = json::parse(text);
+      }
+      trace::Span span("triangulate", "scene");
+      std::vector<std::vector<vec3>> features = {};
+
+      if (js.count("type") > 0 && js["type"] == "FeatureCollection") {
+        for (auto& feature : js["features"]) {
+          std::vector<vec3> triangles = get_triangles(feature);
+          if (triangles.size() > 0)
+            features.push_back(triangles);
+        }
+      }
+      else {
+        std::vector<vec3> triangles = get_triangles(js);
+        if (triangles.size() > 0)
+          features.push_back(triangles);
+      }
+
+      return features;
+    }
   }
 }
 
@@ -4,6 +4,7 @@
 #define EPS 0.00001
 
 #include <string>
+#include <vector>
 #include <float.h> // FLT_MIN
 #include <math.h> // sqrt
 
@@ -44,15 +45,15 @@ namespace quavis {
     }
   } vec2;
 
-  float abs(float x) {
+  inline float abs(float x) {
     return x > 0 ? x : -x;
   }
 
-  float abs(vec2 p) {
+  inline float abs(vec2 p) {
     return sqrt(p*p);
   }
 
-  float ccw(vec2 p1, vec2 p2, vec2 p3) {
+  inline float ccw(vec2 p1, vec2 p2, vec2 p3) {
     return (p2.x - p1.x)*(p3.y - p1.y) - (p2.y - p1.y)*(p3.x - p1.x);
   }
 
@@ -93,13 +94,39 @@ namespace quavis {
     }
   } vec3;
 
-  float abs(vec3 p) {
+  inline float abs(vec3 p) {
     return sqrt(p*p);
   }
 
   typedef struct mat4 {
     float data[16];
   } mat4;
+
+  /**
+   * A read-only view of contiguous points owned by someone else, such that
+   * point lists can be passed on without copying them.
+   */
+  class vec3_span {
+  public:
+    vec3_span() : data_(nullptr), size_(0) {}
+    vec3_span(const vec3* data, size_t size) : data_(data), size_(size) {}
+    vec3_span(const std::vector<vec3>& points) : data_(points.data()), size_(points.size()) {}
+
+    const vec3* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const vec3& operator[](size_t i) const { return data_[i]; }
+    const vec3* begin() const { return data_; }
+    const vec3* end() const { return data_ + size_; }
+
+    vec3_span subspan(size_t offset, size_t count) const {
+      return vec3_span(data_ + offset, count);
+    }
+
+  private:
+    const vec3* data_;
+    size_t size_;
+  };
 }
 
 #endif
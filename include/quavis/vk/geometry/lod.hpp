@@ -0,0 +1,162 @@
+#ifndef LOD_HPP
+#define LOD_HPP
+
+#include <vector>
+#include <algorithm> // sort, max
+#include <cmath> // abs, sqrt
+
+#include "quavis/vk/geometry/geometry.h"
+
+namespace quavis {
+  namespace lod {
+    /**
+     * Convex hull of points in the x-y-plane (Andrew's monotone chain). The
+     * hull is returned in counter-clockwise order without collinear points.
+     */
+    inline std::vector<vec2> convex_hull(std::vector<vec2> points) {
+      std::sort(points.begin(), points.end(), [](vec2 a, vec2 b) {
+        return a.x < b.x || (a.x == b.x && a.y < b.y);
+      });
+
+      if (points.size() < 3)
+        return points;
+
+      std::vector<vec2> hull(2 * points.size());
+      size_t k = 0;
+
+      // lower hull
+      for (size_t i = 0; i < points.size(); i++) {
+        while (k >= 2 && ccw(hull[k-2], hull[k-1], points[i]) <= 0) k--;
+        hull[k++] = points[i];
+      }
+
+      // upper hull
+      for (size_t i = points.size() - 1, t = k + 1; i > 0; i--) {
+        while (k >= t && ccw(hull[k-2], hull[k-1], points[i-1]) <= 0) k--;
+        hull[k++] = points[i-1];
+      }
+
+      hull.resize(k - 1);
+      return hull;
+    }
+
+    /**
+     * Removes the vertices of a convex outline as long as no point of the
+     * original outline moves further than tolerance from the result, keeping
+     * at least a triangle. The result is convex as well.
+     */
+    inline std::vector<vec2> decimate(const std::vector<vec2>& outline, float tolerance) {
+      // indices of the kept vertices in the original outline
+      std::vector<size_t> kept(outline.size());
+      for (size_t i = 0; i < kept.size(); i++)
+        kept[i] = i;
+
+      // the largest distance of the original points between the neighbours of
+      // kept[k] from the edge that replaces it
+      auto error = [&](size_t k) {
+        size_t n = kept.size(), first = kept[(k + n - 1) % n], last = kept[(k + 1) % n];
+        vec2 a = outline[first], b = outline[last];
+        float length = sqrt((b.x - a.x) * (b.x - a.x) + (b.y - a.y) * (b.y - a.y));
+        float result = 0;
+        for (size_t i = (first + 1) % outline.size(); i != last; i = (i + 1) % outline.size())
+          result = std::max(result, length > 0 ? ccw(b, a, outline[i]) / length : 0.0f);
+        return result;
+      };
+
+      while (kept.size() > 3) {
+        size_t best = 0;
+        float best_error = error(0);
+        for (size_t k = 1; k < kept.size(); k++) {
+          float e = error(k);
+          if (e < best_error) {
+            best = k;
+            best_error = e;
+          }
+        }
+        if (best_error > tolerance)
+          break;
+        kept.erase(kept.begin() + best);
+      }
+
+      std::vector<vec2> result(kept.size());
+      for (size_t k = 0; k < kept.size(); k++)
+        result[k] = outline[kept[k]];
+      return result;
+    }
+
+    /**
+     * Simplified geometry of a feature: the convex hull of its footprint,
+     * decimated within tolerance and extruded from the lowest to the highest
+     * point of the feature. It has no floor, which observers above the ground
+     * do not see. The result is a list of triangles (three points each).
+     */
+    inline std::vector<vec3> extruded_hull(const std::vector<vec3>& triangles, float z_min, float z_max, float tolerance) {
+      std::vector<vec2> footprint(triangles.size());
+      for (size_t i = 0; i < triangles.size(); i++)
+        footprint[i] = {triangles[i].x, triangles[i].y};
+
+      std::vector<vec2> hull = convex_hull(footprint);
+      std::vector<vec3> result = {};
+      if (hull.size() < 2)
+        return result;
+      if (hull.size() > 3)
+        hull = decimate(hull, tolerance);
+
+      // walls
+      size_t num_walls = hull.size() == 2 ? 1 : hull.size();
+      for (size_t i = 0; i < num_walls; i++) {
+        vec2 a = hull[i], b = hull[(i + 1) % hull.size()];
+        result.insert(result.end(), {
+          {a.x, a.y, z_min}, {b.x, b.y, z_min}, {b.x, b.y, z_max},
+          {b.x, b.y, z_max}, {a.x, a.y, z_max}, {a.x, a.y, z_min}
+        });
+      }
+
+      // roof (a triangle fan, the hull is convex)
+      for (size_t i = 1; i + 1 < hull.size(); i++) {
+        vec2 a = hull[0], b = hull[i], c = hull[i+1];
+        result.insert(result.end(), {{a.x, a.y, z_max}, {b.x, b.y, z_max}, {c.x, c.y, z_max}});
+      }
+
+      return result;
+    }
+
+    /**
+     * Whether the extruded hull of a feature matches its exact geometry: the
+     * flat roof (its triangles at z_max) covers the convex hull of the
+     * footprint. Holes, courtyards, concave footprints, pitched roofs and
+     * terrain leave parts of the hull uncovered.
+     */
+    inline bool is_building_like(const std::vector<vec3>& triangles, float z_min, float z_max) {
+      float epsilon = 1e-4f * std::max(1.0f, z_max - z_min);
+      float roof_area = 0;
+      std::vector<vec2> footprint(triangles.size());
+      for (size_t i = 0; i < triangles.size(); i++)
+        footprint[i] = {triangles[i].x, triangles[i].y};
+      for (size_t i = 0; i + 2 < triangles.size(); i += 3) {
+        if (z_max - triangles[i].z < epsilon && z_max - triangles[i+1].z < epsilon && z_max - triangles[i+2].z < epsilon)
+          roof_area += 0.5f * std::abs(ccw(footprint[i], footprint[i+1], footprint[i+2]));
+      }
+
+      std::vector<vec2> hull = convex_hull(footprint);
+      float hull_area = 0;
+      for (size_t i = 1; i + 1 < hull.size(); i++)
+        hull_area += 0.5f * ccw(hull[0], hull[i], hull[i+1]);
+      return hull_area > 0 && std::abs(roof_area - hull_area) <= 1e-3f * hull_area;
+    }
+
+    /**
+     * Simplified level of detail of a feature: its extruded hull if it is
+     * building-like and the hull has fewer triangles, otherwise the exact
+     * geometry. No point moves further than tolerance.
+     */
+    inline std::vector<vec3> simplify(const std::vector<vec3>& triangles, float z_min, float z_max, float tolerance) {
+      if (!is_building_like(triangles, z_min, z_max))
+        return triangles;
+      std::vector<vec3> hull = extruded_hull(triangles, z_min, z_max, tolerance);
+      return hull.size() < triangles.size() ? hull : triangles;
+    }
+  }
+}
+
+#endif // LOD_HPP
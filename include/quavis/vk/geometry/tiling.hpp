@@ -0,0 +1,170 @@
+#ifndef TILING_HPP
+#define TILING_HPP
+
+#include <vector>
+#include <numeric> // iota
+#include <algorithm> // sort, min, max
+#include <stdint.h>
+
+#include "quavis/vk/geometry/geometry.h"
+
+namespace quavis {
+  namespace tiling {
+    /**
+     * A contiguous range in the index buffer that can be drawn with a single
+     * vkCmdDrawIndexed call.
+     */
+    struct DrawRange {
+      uint32_t first_index;
+      uint32_t index_count;
+
+      bool operator==(const DrawRange& other) const {
+        return first_index == other.first_index && index_count == other.index_count;
+      }
+    };
+
+    /**
+     * A tile of the scene. The triangles of a tile are stored contiguously in
+     * the index buffer and are fully contained in the tile's bounding box.
+     * Every level of detail has its own range: level 0 is the exact geometry,
+     * higher levels are increasingly simplified.
+     */
+    struct Tile {
+      std::vector<DrawRange> levels;
+      vec3 min;
+      vec3 max;
+    };
+
+    /**
+     * A uniform grid in the x-y-plane that is used to assign features and
+     * observation points to tiles.
+     */
+    struct Grid {
+      vec2 origin;
+      float cell_size;
+      uint32_t nx;
+      uint32_t ny;
+
+      uint32_t cell(vec3 p) const {
+        int64_t ix = (int64_t)floor((p.x - origin.x) / cell_size);
+        int64_t iy = (int64_t)floor((p.y - origin.y) / cell_size);
+        ix = std::min<int64_t>(std::max<int64_t>(ix, 0), nx - 1);
+        iy = std::min<int64_t>(std::max<int64_t>(iy, 0), ny - 1);
+        return (uint32_t)(iy * nx + ix);
+      }
+
+      uint32_t size() const {
+        return nx * ny;
+      }
+    };
+
+    inline vec3 min(vec3 a, vec3 b) {
+      return {std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z)};
+    }
+
+    inline vec3 max(vec3 a, vec3 b) {
+      return {std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z)};
+    }
+
+    /**
+     * Computes the bounding box of a list of points. Returns false if the list
+     * is empty.
+     */
+    inline bool bounds(const std::vector<vec3>& points, vec3& bmin, vec3& bmax) {
+      if (points.empty())
+        return false;
+
+      bmin = points[0];
+      bmax = points[0];
+      for (const vec3& p : points) {
+        bmin = min(bmin, p);
+        bmax = max(bmax, p);
+      }
+      return true;
+    }
+
+    /**
+     * Squared distance between two axis aligned boxes (0 if they intersect)
+     */
+    inline float distance2(vec3 amin, vec3 amax, vec3 bmin, vec3 bmax) {
+      float dx = std::max(0.0f, std::max(amin.x - bmax.x, bmin.x - amax.x));
+      float dy = std::max(0.0f, std::max(amin.y - bmax.y, bmin.y - amax.y));
+      float dz = std::max(0.0f, std::max(amin.z - bmax.z, bmin.z - amax.z));
+      return dx*dx + dy*dy + dz*dz;
+    }
+
+    /**
+     * Creates a grid covering the given box. The cells have at least the given
+     * size, but the grid never has more than max_cells cells per axis.
+     */
+    inline Grid make_grid(vec3 bmin, vec3 bmax, float cell_size, uint32_t max_cells) {
+      float extent = std::max(bmax.x - bmin.x, bmax.y - bmin.y);
+      cell_size = std::max(cell_size, extent / max_cells);
+      if (cell_size <= 0)
+        cell_size = 1;
+
+      Grid grid;
+      grid.origin = {bmin.x, bmin.y};
+      grid.cell_size = cell_size;
+      grid.nx = std::max<uint32_t>(1, (uint32_t)ceil((bmax.x - bmin.x) / cell_size));
+      grid.ny = std::max<uint32_t>(1, (uint32_t)ceil((bmax.y - bmin.y) / cell_size));
+      grid.nx = std::min(grid.nx, max_cells);
+      grid.ny = std::min(grid.ny, max_cells);
+      return grid;
+    }
+
+    /**
+     * Returns the indices of the given points ordered by their grid cell, such
+     * that points of the same cell are consecutive.
+     */
+    inline std::vector<size_t> sort_by_cell(const Grid& grid, vec3_span points) {
+      std::vector<uint32_t> cells(points.size());
+      for (size_t i = 0; i < points.size(); i++)
+        cells[i] = grid.cell(points[i]);
+
+      std::vector<size_t> order(points.size());
+      std::iota(order.begin(), order.end(), 0);
+      std::stable_sort(order.begin(), order.end(), [&cells](size_t a, size_t b) {
+        return cells[a] < cells[b];
+      });
+      return order;
+    }
+
+    /**
+     * Selects all tiles that contain geometry within the given radius of the
+     * box [bmin, bmax] and merges them into as few draw ranges as possible.
+     * A tile further away than lod_distances[l] is drawn with level l+1.
+     */
+    inline std::vector<DrawRange> select(const std::vector<Tile>& tiles, vec3 bmin, vec3 bmax, float radius, const std::vector<float>& lod_distances) {
+      std::vector<DrawRange> selected = {};
+      float radius2 = radius * radius;
+      for (const Tile& tile : tiles) {
+        float d2 = distance2(tile.min, tile.max, bmin, bmax);
+        if (d2 > radius2)
+          continue;
+
+        size_t level = 0;
+        while (level < lod_distances.size() && level + 1 < tile.levels.size() && d2 > lod_distances[level] * lod_distances[level])
+          level++;
+
+        if (tile.levels[level].index_count > 0)
+          selected.push_back(tile.levels[level]);
+      }
+
+      std::sort(selected.begin(), selected.end(), [](DrawRange a, DrawRange b) {
+        return a.first_index < b.first_index;
+      });
+
+      std::vector<DrawRange> ranges = {};
+      for (DrawRange range : selected) {
+        if (!ranges.empty() && ranges.back().first_index + ranges.back().index_count == range.first_index)
+          ranges.back().index_count += range.index_count;
+        else
+          ranges.push_back(range);
+      }
+      return ranges;
+    }
+  }
+}
+
+#endif // TILING_HPP
@@ -0,0 +1,254 @@
+#ifndef SUBALLOCATOR_HPP
+#define SUBALLOCATOR_HPP
+
+#include "quavis/vk/debug.h"
+
+#include <vulkan/vulkan.h>
+#include <algorithm>
+#include <iterator>
+#include <list>
+#include <map>
+
+namespace quavis {
+  /**
+  * The free ranges of an arena, ordered by their offset. Adjacent ranges are
+  * merged when they are freed.
+  */
+  class FreeList {
+  public:
+    FreeList(VkDeviceSize size) {
+      if (size > 0)
+        this->ranges_[0] = size;
+    }
+
+    /**
+    * Takes the first range that fits size bytes at the given alignment (a
+    * power of two). Returns false if there is none.
+    */
+    bool Take(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset) {
+      for (auto it = this->ranges_.begin(); it != this->ranges_.end(); it++) {
+        VkDeviceSize begin = it->first, end = it->first + it->second;
+        VkDeviceSize aligned = (begin + alignment - 1) & ~(alignment - 1);
+        if (aligned + size > end)
+          continue;
+
+        // the padding in front and the rest stay free
+        this->ranges_.erase(it);
+        if (aligned > begin)
+          this->ranges_[begin] = aligned - begin;
+        if (aligned + size < end)
+          this->ranges_[aligned + size] = end - aligned - size;
+        offset = aligned;
+        this->used_ += size;
+        return true;
+      }
+      return false;
+    }
+
+    /**
+    * Returns a range taken before.
+    */
+    void Give(VkDeviceSize offset, VkDeviceSize size) {
+      this->used_ -= size;
+      auto next = this->ranges_.lower_bound(offset);
+      if (next != this->ranges_.end() && offset + size == next->first) {
+        size += next->second;
+        next = this->ranges_.erase(next);
+      }
+      if (next != this->ranges_.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset) {
+          previous->second += size;
+          return;
+        }
+      }
+      this->ranges_[offset] = size;
+    }
+
+    bool IsEmpty() const {
+      return this->used_ == 0;
+    }
+
+    VkDeviceSize GetUsed() const {
+      return this->used_;
+    }
+
+    size_t GetRangeCount() const {
+      return this->ranges_.size();
+    }
+
+  private:
+    VkDeviceSize used_ = 0;
+    std::map<VkDeviceSize, VkDeviceSize> ranges_ = {}; // offset -> size
+  };
+
+  /**
+  * A range of device memory handed out by a SubAllocator: the memory object
+  * of its arena and the offset the resource is bound at.
+  */
+  struct Allocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void *mapped = nullptr; // the range in host memory if the memory is host visible
+  };
+
+  /**
+  * Places the buffers and images of a device in a few large arenas per
+  * memory type instead of allocating memory for each of them. Drivers limit
+  * the number of allocations and every allocation has an overhead.
+  *
+  * A new arena of a memory type is twice the size of the last one, from
+  * arena_size / 8 up to arena_size. Resources that do not fit into that get
+  * an arena of their own, which is freed with them. Host visible arenas are
+  * mapped once, for as long as they exist. Not thread-safe.
+  */
+  class SubAllocator {
+  public:
+    SubAllocator(VkPhysicalDevice physical_device, VkDevice logical_device, VkDeviceSize arena_size = 64 << 20)
+      : logical_device_(logical_device), arena_size_(arena_size) {
+      vkGetPhysicalDeviceMemoryProperties(physical_device, &this->memory_properties_);
+      VkPhysicalDeviceProperties properties;
+      vkGetPhysicalDeviceProperties(physical_device, &properties);
+      this->granularity_ = std::max<VkDeviceSize>(properties.limits.bufferImageGranularity, 1);
+    }
+
+    ~SubAllocator() {
+      for (Arena& arena : this->arenas_)
+        vkFreeMemory(this->logical_device_, arena.memory, nullptr);
+    }
+
+    /**
+    * Allocates memory of the first memory type with the given properties
+    * that meets the requirements, throws if there is none. Optimal tiled
+    * images are not linear: they
+    * are padded to the bufferImageGranularity, such that no buffer or linear
+    * image shares a page with them.
+    */
+    Allocation Allocate(VkMemoryRequirements requirements, VkMemoryPropertyFlags flags, bool linear) {
+      uint32_t memory_type = this->memory_properties_.memoryTypeCount;
+      for (uint32_t i = 0; i < this->memory_properties_.memoryTypeCount; i++) {
+        if ((requirements.memoryTypeBits & (1 << i)) && (this->memory_properties_.memoryTypes[i].propertyFlags & flags) == flags) {
+          memory_type = i;
+          break;
+        }
+      }
+      if (memory_type == this->memory_properties_.memoryTypeCount)
+        throw "No suitable memory type.";
+
+      VkDeviceSize size = requirements.size;
+      VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+      if (!linear) {
+        alignment = std::max(alignment, this->granularity_);
+        size = (size + this->granularity_ - 1) / this->granularity_ * this->granularity_;
+      }
+
+      Allocation allocation = {};
+      allocation.size = size;
+      VkDeviceSize last_size = 0;
+      for (Arena& arena : this->arenas_) {
+        if (arena.memory_type != memory_type || arena.dedicated)
+          continue;
+        last_size = arena.size;
+        if (arena.free.Take(size, alignment, allocation.offset))
+          return this->Place(arena, allocation);
+      }
+
+      VkDeviceSize arena_size = last_size == 0 ? this->arena_size_ / 8 : std::min(2 * last_size, this->arena_size_);
+      bool dedicated = size > arena_size;
+      Arena& arena = this->CreateArena(memory_type, dedicated ? size : arena_size, dedicated);
+      arena.free.Take(size, alignment, allocation.offset);
+      return this->Place(arena, allocation);
+    }
+
+    void Free(const Allocation& allocation) {
+      for (auto it = this->arenas_.begin(); it != this->arenas_.end(); it++) {
+        if (it->memory != allocation.memory)
+          continue;
+
+        it->free.Give(allocation.offset, allocation.size);
+        if (it->dedicated && it->free.IsEmpty()) {
+          vkFreeMemory(this->logical_device_, it->memory, nullptr);
+          this->arenas_.erase(it);
+        }
+        return;
+      }
+    }
+
+    /**
+    * Returns the bytes of all arenas.
+    */
+    VkDeviceSize GetAllocatedBytes() const {
+      VkDeviceSize bytes = 0;
+      for (const Arena& arena : this->arenas_)
+        bytes += arena.size;
+      return bytes;
+    }
+
+    /**
+    * Returns the bytes of the arenas taken by resources, images rounded up
+    * to the bufferImageGranularity.
+    */
+    VkDeviceSize GetUsedBytes() const {
+      VkDeviceSize bytes = 0;
+      for (const Arena& arena : this->arenas_)
+        bytes += arena.free.GetUsed();
+      return bytes;
+    }
+
+    size_t GetArenaCount() const {
+      return this->arenas_.size();
+    }
+
+  private:
+    struct Arena {
+      VkDeviceMemory memory;
+      uint32_t memory_type;
+      VkDeviceSize size;
+      bool dedicated; // holds a single resource
+      void *mapped;
+      FreeList free;
+    };
+
+    Arena& CreateArena(uint32_t memory_type, VkDeviceSize size, bool dedicated) {
+      VkMemoryAllocateInfo allocation_info = {
+        VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, // sType
+        nullptr, // pNext (see documentation, must be null)
+        size, // the memory size
+        memory_type // the memory type index
+      };
+
+      VkDeviceMemory memory;
+      debug::handleVkResult(
+        vkAllocateMemory(
+          this->logical_device_, // the logical device
+          &allocation_info, // the allocation info
+          nullptr, // allocation callback
+          &memory // allocated memory for memory object
+        )
+      );
+
+      void *mapped = nullptr;
+      if (this->memory_properties_.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        debug::handleVkResult(vkMapMemory(this->logical_device_, memory, 0, VK_WHOLE_SIZE, 0, &mapped));
+
+      this->arenas_.push_back({memory, memory_type, size, dedicated, mapped, FreeList(size)});
+      return this->arenas_.back();
+    }
+
+    Allocation& Place(Arena& arena, Allocation& allocation) {
+      allocation.memory = arena.memory;
+      if (arena.mapped)
+        allocation.mapped = (char *) arena.mapped + allocation.offset;
+      return allocation;
+    }
+
+    VkDevice logical_device_;
+    VkDeviceSize arena_size_;
+    VkDeviceSize granularity_;
+    VkPhysicalDeviceMemoryProperties memory_properties_;
+    std::list<Arena> arenas_ = {}; // stable references, dedicated arenas are removed
+  };
+}
+
+#endif // SUBALLOCATOR_HPP
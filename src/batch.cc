@@ -0,0 +1,253 @@
+#include "quavis/quavis.h"
+#include "quavis/cpu/context.h"
+#include "quavis/trace.h"
+
+#include <algorithm>
+#include <argp.h>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+/**
+* The metrics computed by default, in the order of the output columns.
+*/
+const std::vector<std::string> all_metrics = {"area", "minradial", "maxradial", "volume", "skyratio"};
+
+bool ends_with(std::string s, std::string suffix) {
+  return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+std::string read_file(std::string path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    throw "Could not open input file.";
+  std::stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+/**
+* Reads the observation points, either as CSV (x,y,z per line, lines not
+* starting with a number such as a header are skipped) or in the binary
+* layout of the services' points attachment (x, y, z as 32 bit floats).
+*/
+std::vector<quavis::vec3> read_points(std::string path, bool csv) {
+  std::string contents = read_file(path);
+  std::vector<quavis::vec3> points = {};
+  if (!csv) {
+    if (contents.size() % sizeof(quavis::vec3) != 0)
+      throw "The size of the points file is not a multiple of 12 bytes.";
+    const quavis::vec3 *raw = (const quavis::vec3 *) contents.data();
+    return std::vector<quavis::vec3>(raw, raw + contents.size() / sizeof(quavis::vec3));
+  }
+
+  std::istringstream lines(contents);
+  std::string line;
+  while (std::getline(lines, line)) {
+    quavis::vec3 p;
+    if (sscanf(line.c_str(), "%f%*[ ,;\t]%f%*[ ,;\t]%f", &p.x, &p.y, &p.z) == 3)
+      points.push_back(p);
+  }
+  return points;
+}
+
+/**
+* Writes the results, either as CSV with a header (x,y,z and a column per
+* metric) or binary (a 32 bit float per point and metric, point by point).
+*/
+void write_results(std::string path, bool csv, const std::vector<quavis::vec3>& points, std::vector<std::string> metrics, std::map<std::string, std::vector<float>>& results) {
+  std::ofstream file(path, std::ios::binary);
+  if (!file)
+    throw "Could not open output file.";
+
+  if (csv) {
+    file << "x,y,z";
+    for (std::string metric : metrics)
+      file << "," << metric;
+    file << "\n";
+    file.precision(9);
+    for (size_t i = 0; i < points.size(); i++) {
+      file << points[i].x << "," << points[i].y << "," << points[i].z;
+      for (std::string metric : metrics)
+        file << "," << results[metric][i];
+      file << "\n";
+    }
+  } else {
+    std::vector<float> values(points.size() * metrics.size());
+    for (size_t i = 0; i < points.size(); i++)
+      for (size_t m = 0; m < metrics.size(); m++)
+        values[i * metrics.size() + m] = results[metrics[m]][i];
+    file.write((const char *) values.data(), values.size() * sizeof(float));
+  }
+
+  if (!file)
+    throw "Could not write output file.";
+}
+
+/* Argument parsing options */
+struct arguments {
+  char const *paths[3];
+  char const *metrics;
+  double alpha_max;
+  double r_max;
+  char const *backend;
+  int threads;
+  int width;
+  int height;
+  char const *kernel;
+  char const *trace;
+  char const *pipeline_cache;
+};
+static char doc[] = "Computes isovist metrics for the points of a points file in the scene of a GeoJSON file without Luci. Points and results are read and written as CSV if the file names end with .csv and binary otherwise.";
+static char args_doc[] = "SCENE POINTS OUTPUT";
+static struct argp_option options[] = {
+  {"metrics",   'm', "area,minradial,maxradial,volume,skyratio", 0, "The comma separated metrics to compute, in the order of the output columns"},
+  {"alpha-max", 'a', "0.1",  0, "The maximum angle in radians an edge may cover after tessellation"},
+  {"r-max",     'r', "5000", 0, "The maximum distance that is visible"},
+  {"backend",   'b', "gpu",  0, "Where the isovists are computed\ngpu: on the graphics card, cpu: with ray casting"},
+  {"threads",   't', "0",    0, "The number of threads of the cpu backend, 0 uses all cores"},
+  {"width",     'W', "128",  0, "The width of the spherical image (cpu backend only, the device's is fixed by the shaders)"},
+  {"height",    'H', "64",   0, "The height of the spherical image (cpu backend only)"},
+  {"kernel",    'k', "",     0, "Forces a packet kernel of the cpu backend\navx512, avx2 or scalar"},
+  {"trace",     'x', "FILE", 0, "Writes a Chrome trace (chrome://tracing, Perfetto) of the stages on the host and the device"},
+  {"pipeline-cache", 'C', "FILE", 0, "Reads the compiled pipelines of the gpu backend from and writes them to the file"},
+  {0}
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+  struct arguments *args = (arguments *) (state->input);
+  switch (key) {
+    case 'm':
+      args->metrics = arg;
+      break;
+    case 'a':
+      args->alpha_max = arg ? atof(arg) : 0.1;
+      break;
+    case 'r':
+      args->r_max = arg ? atof(arg) : 5000;
+      break;
+    case 'b':
+      args->backend = arg;
+      break;
+    case 't':
+      args->threads = arg ? atoi(arg) : 0;
+      break;
+    case 'W':
+      args->width = arg ? atoi(arg) : 128;
+      break;
+    case 'H':
+      args->height = arg ? atoi(arg) : 64;
+      break;
+    case 'k':
+      args->kernel = arg;
+      break;
+    case 'x':
+      args->trace = arg;
+      break;
+    case 'C':
+      args->pipeline_cache = arg;
+      break;
+    case ARGP_KEY_ARG:
+      if (state->arg_num >= 3) argp_usage(state);
+      args->paths[state->arg_num] = arg;
+      break;
+    case ARGP_KEY_END:
+      if (state->arg_num < 3) argp_usage(state);
+      break;
+    default:
+      return ARGP_ERR_UNKNOWN;
+  }
+  return 0;
+}
+
+/* Run one batch using arguments */
+int main(int argc, char **argv) {
+  struct arguments args;
+
+  /* Default values. */
+  args.metrics = "area,minradial,maxradial,volume,skyratio";
+  args.alpha_max = 0.1;
+  args.r_max = 5000;
+  args.backend = "gpu";
+  args.threads = 0;
+  args.width = 128;
+  args.height = 64;
+  args.kernel = "";
+  args.trace = "";
+  args.pipeline_cache = "";
+
+  /* Parse our arguments; every option seen by parse_opt will be
+     reflected in arguments. */
+  static struct argp argp = {options, parse_opt, args_doc, doc};
+  argp_parse(&argp, argc, argv, 0, 0, &args);
+
+  std::vector<std::string> metrics = {};
+  std::istringstream names(args.metrics);
+  std::string name;
+  while (std::getline(names, name, ','))
+    metrics.push_back(name);
+
+  /* Every stage is timed separately */
+  quavis::Trace trace;
+  bool traced = std::string(args.trace) != "";
+  quavis::trace::Scope scope(traced ? &trace : nullptr);
+  auto start = std::chrono::steady_clock::now();
+  auto stage = [&](std::string name) {
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed = now - start;
+    std::cout << "INFO: " << name << " took " << elapsed.count() << " s" << std::endl;
+    if (traced)
+      trace.Complete(name, "batch", start, now);
+    start = now;
+    return elapsed.count();
+  };
+
+  try {
+    for (std::string metric : metrics)
+      if (std::find(all_metrics.begin(), all_metrics.end(), metric) == all_metrics.end())
+        throw "Unknown metric.";
+
+    std::string scene = read_file(args.paths[0]);
+    stage("Reading the scene");
+    std::vector<quavis::vec3> points = read_points(args.paths[1], ends_with(args.paths[1], ".csv"));
+    stage("Reading " + std::to_string(points.size()) + " points");
+
+    std::unique_ptr<quavis::Backend> context;
+    if (std::string(args.backend) == "cpu") {
+      quavis::cpu::Context *cpu = new quavis::cpu::Context(metrics, args.threads, args.width, args.height, args.kernel);
+      std::cout << "INFO: " << "Using the " << cpu->GetKernelName() << " kernel" << std::endl;
+      context.reset(cpu);
+    } else if (std::string(args.backend) == "gpu") {
+      if (args.width != 128 || args.height != 64)
+        throw "The device renders 128x64 images, the resolution is fixed by the shaders.";
+      context.reset(new quavis::Context(metrics, true, args.pipeline_cache));
+    } else {
+      throw "Unknown backend.";
+    }
+    stage("Creating the context");
+
+    // without points only the scene is parsed and uploaded, the following
+    // call finds it cached
+    context->Parse(scene, quavis::vec3_span(), args.alpha_max, args.r_max, metrics);
+    stage("Loading the scene");
+    std::map<std::string, std::vector<float>> results = context->Parse(scene, points, args.alpha_max, args.r_max, metrics);
+    double seconds = stage("Computing the isovists");
+    std::cout << "INFO: " << points.size() / seconds << " points per second" << std::endl;
+    for (auto& stage : context->GetStageTimes())
+      std::cout << "INFO: " << "  " << stage.first << ": " << stage.second << " s" << std::endl;
+    for (auto& statistic : context->GetPipelineStatistics())
+      std::cout << "INFO: " << "  " << statistic.first << ": " << statistic.second << std::endl;
+
+    write_results(args.paths[2], ends_with(args.paths[2], ".csv"), points, metrics, results);
+    stage("Writing the results");
+
+    if (traced && !trace.Write(args.trace))
+      throw "Could not write the trace.";
+  }
+  catch (const char *what) {
+    std::cout << "ERROR: " << what << std::endl;
+    return -1;
+  }
+}
@@ -0,0 +1,410 @@
+#include "quavis/quavis.h"
+#include "quavis/cpu/context.h"
+#include "quavis/vk/geometry/triangulation.hpp"
+
+#include <argp.h>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <unordered_map>
+
+/**
+* A polygon as its rings, each closed (the last point repeats the first), the
+* first being the outer ring and the others its holes.
+*/
+typedef std::vector<std::vector<quavis::vec3>> Polygon;
+
+/**
+* A synthetic city: a grid of box shaped buildings of random height, some
+* with a courtyard, standing on a terrain.
+*/
+struct CityOptions {
+  int buildings; // buildings per side of the grid
+  float lot; // edge length of a building's lot
+  float street; // width of the streets between the lots
+  float min_height;
+  float max_height;
+  float courtyards; // fraction of the buildings with a courtyard
+  float terrain; // amplitude of the terrain, 0 for flat ground
+  int terrain_cells; // terrain cells per side
+  unsigned int seed;
+};
+
+struct City {
+  std::vector<std::vector<Polygon>> features = {}; // per building, the terrain last
+  size_t courtyards = 0;
+  float extent = 0;
+};
+
+float terrain_height(const CityOptions& options, float x, float y) {
+  return options.terrain * sinf(x * 0.01f) * cosf(y * 0.013f);
+}
+
+Polygon rectangle(quavis::vec3 a, quavis::vec3 b, quavis::vec3 c, quavis::vec3 d) {
+  return {{a, b, c, d, a}};
+}
+
+/**
+* Vertical walls along the closed ring, from z to z + height.
+*/
+void add_walls(std::vector<Polygon>& feature, std::vector<quavis::vec2> ring, float z, float height) {
+  for (size_t i = 0; i < ring.size(); i++) {
+    quavis::vec2 p = ring[i], q = ring[(i + 1) % ring.size()];
+    feature.push_back(rectangle({p.x, p.y, z}, {q.x, q.y, z}, {q.x, q.y, z + height}, {p.x, p.y, z + height}));
+  }
+}
+
+City generate_city(const CityOptions& options) {
+  std::mt19937 random(options.seed);
+  std::uniform_real_distribution<float> uniform(0, 1);
+  City city;
+  city.extent = options.buildings * (options.lot + options.street);
+
+  for (int i = 0; i < options.buildings; i++) {
+    for (int j = 0; j < options.buildings; j++) {
+      // the footprint covers 60 to 100 percent of the lot's edges
+      float x0 = options.street / 2 + i * (options.lot + options.street);
+      float y0 = options.street / 2 + j * (options.lot + options.street);
+      float x1 = x0 + options.lot * (0.6f + 0.4f * uniform(random));
+      float y1 = y0 + options.lot * (0.6f + 0.4f * uniform(random));
+      float height = options.min_height + (options.max_height - options.min_height) * uniform(random);
+      float z = std::min(std::min(terrain_height(options, x0, y0), terrain_height(options, x1, y0)),
+                         std::min(terrain_height(options, x0, y1), terrain_height(options, x1, y1)));
+
+      std::vector<Polygon> building = {};
+      std::vector<quavis::vec2> outer = {{x0, y0}, {x1, y0}, {x1, y1}, {x0, y1}};
+      add_walls(building, outer, z, height);
+      Polygon roof = rectangle({x0, y0, z + height}, {x1, y0, z + height}, {x1, y1, z + height}, {x0, y1, z + height});
+      if (uniform(random) < options.courtyards) {
+        // a hole in the roof and the walls around it
+        float dx = (x1 - x0) / 3, dy = (y1 - y0) / 3;
+        std::vector<quavis::vec2> inner = {{x0 + dx, y0 + dy}, {x1 - dx, y0 + dy}, {x1 - dx, y1 - dy}, {x0 + dx, y1 - dy}};
+        add_walls(building, inner, z, height);
+        roof.push_back({});
+        for (quavis::vec2 p : inner)
+          roof.back().push_back({p.x, p.y, z + height});
+        roof.back().push_back(roof.back()[0]);
+        city.courtyards++;
+      }
+      building.push_back(roof);
+      city.features.push_back(building);
+    }
+  }
+
+  if (options.terrain_cells > 0) {
+    std::vector<Polygon> terrain = {};
+    float cell = city.extent / options.terrain_cells;
+    for (int i = 0; i < options.terrain_cells; i++) {
+      for (int j = 0; j < options.terrain_cells; j++) {
+        float x0 = i * cell, y0 = j * cell, x1 = x0 + cell, y1 = y0 + cell;
+        quavis::vec3 a = {x0, y0, terrain_height(options, x0, y0)}, b = {x1, y0, terrain_height(options, x1, y0)};
+        quavis::vec3 c = {x1, y1, terrain_height(options, x1, y1)}, d = {x0, y1, terrain_height(options, x0, y1)};
+        terrain.push_back({{a, b, c, a}});
+        terrain.push_back({{a, c, d, a}});
+      }
+    }
+    city.features.push_back(terrain);
+  }
+  return city;
+}
+
+std::string to_geojson(const City& city) {
+  json features = json::array();
+  for (const std::vector<Polygon>& feature : city.features) {
+    json polygons = json::array();
+    for (const Polygon& polygon : feature) {
+      json rings = json::array();
+      for (const std::vector<quavis::vec3>& ring : polygon) {
+        json points = json::array();
+        for (quavis::vec3 p : ring)
+          points.push_back({p.x, p.y, p.z});
+        rings.push_back(points);
+      }
+      polygons.push_back(rings);
+    }
+    features.push_back({{"type", "Feature"}, {"geometry", {{"type", "MultiPolygon"}, {"coordinates", polygons}}}});
+  }
+  return json({{"type", "FeatureCollection"}, {"features", features}}).dump();
+}
+
+/**
+* Observers in a regular grid over the city, at eye level above the terrain.
+*/
+std::vector<quavis::vec3> observer_grid(const CityOptions& options, float extent, int side) {
+  std::vector<quavis::vec3> points = {};
+  for (int i = 0; i < side; i++) {
+    for (int j = 0; j < side; j++) {
+      float x = (i + 0.5f) * extent / side, y = (j + 0.5f) * extent / side;
+      points.push_back({x, y, terrain_height(options, x, y) + 1.5f});
+    }
+  }
+  return points;
+}
+
+/**
+* Runs f repeat times and returns the shortest and the mean time in seconds.
+*/
+json measure(int repeat, std::function<void()> f) {
+  double min = 0, sum = 0;
+  for (int r = 0; r < repeat; r++) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    min = r == 0 ? elapsed.count() : std::min(min, elapsed.count());
+    sum += elapsed.count();
+  }
+  return {{"seconds", min}, {"mean_seconds", sum / repeat}};
+}
+
+/**
+* Benchmarks loading the scene and computing the metrics with one backend.
+* Stage times reported by the backend are the shortest of the repetitions.
+*/
+json benchmark_backend(std::string name, const std::string& scene, const std::vector<quavis::vec3>& points, std::vector<std::string> metrics, float alpha_max, float r_max, int repeat) {
+  json stages = json::object();
+  std::unique_ptr<quavis::Backend> context;
+  stages["create_context"] = measure(1, [&]() {
+    if (name == "cpu")
+      context.reset(new quavis::cpu::Context(metrics));
+    else if (name == "gpu")
+      context.reset(new quavis::Context(metrics));
+    else
+      throw "Unknown backend.";
+  });
+
+  // the scene is cached by its contents, trailing spaces make every
+  // repetition a new one
+  std::string padding = "";
+  stages["load_scene"] = measure(repeat, [&]() {
+    padding += " ";
+    context->Parse(scene + padding, quavis::vec3_span(), alpha_max, r_max, metrics);
+  });
+  context->Parse(scene, quavis::vec3_span(), alpha_max, r_max, metrics);
+
+  std::map<std::string, double> stage_times = {};
+  json isovists = measure(repeat, [&]() {
+    context->Parse(scene, points, alpha_max, r_max, metrics);
+    for (auto& stage : context->GetStageTimes())
+      if (stage.first != "load_scene")
+        stage_times[stage.first] = stage_times.count(stage.first) == 0 ? stage.second : std::min(stage_times[stage.first], stage.second);
+  });
+  isovists["per_point"] = isovists["seconds"].get<double>() / points.size();
+  stages["isovists"] = isovists;
+  for (auto& stage : stage_times)
+    stages[stage.first] = {{"seconds", stage.second}, {"per_point", stage.second / points.size()}};
+  std::map<std::string, uint64_t> statistics = context->GetPipelineStatistics();
+  if (!statistics.empty())
+    stages["pipeline_statistics"] = statistics;
+
+  // each metric alone: one render and its reduction per point
+  for (std::string metric : metrics) {
+    json timing = measure(repeat, [&]() {
+      context->Parse(scene, points, alpha_max, r_max, {metric});
+    });
+    timing["per_point"] = timing["seconds"].get<double>() / points.size();
+    stages["metric." + metric] = timing;
+  }
+  return stages;
+}
+
+/* Argument parsing options */
+struct arguments {
+  CityOptions city;
+  int points;
+  char const *backends;
+  char const *metrics;
+  double alpha_max;
+  double r_max;
+  int repeat;
+  char const *label;
+  char const *output;
+};
+static char doc[] = "Benchmarks every stage of the isovist computation on a synthetic city and writes the times as JSON. Times are the shortest of the repetitions.";
+static char args_doc[] = "";
+static struct argp_option options[] = {
+  {"buildings",     'n', "20",    0, "The number of buildings per side of the city's grid"},
+  {"courtyards",    'c', "0.3",   0, "The fraction of the buildings with a courtyard"},
+  {"min-height",    'z', "5",     0, "The minimum height of a building"},
+  {"max-height",    'Z', "60",    0, "The maximum height of a building"},
+  {"terrain",       't', "10",    0, "The amplitude of the terrain, 0 for flat ground"},
+  {"terrain-cells", 'T', "32",    0, "The number of terrain cells per side, 0 for no terrain"},
+  {"seed",          's', "1",     0, "The seed of the random building sizes"},
+  {"points",        'p', "32",    0, "The number of observers per side of the observer grid"},
+  {"backends",      'b', "gpu,cpu", 0, "The comma separated backends to benchmark"},
+  {"metrics",       'm', "area,minradial,maxradial,volume,skyratio", 0, "The comma separated metrics"},
+  {"alpha-max",     'a', "0.1",   0, "The maximum angle in radians an edge may cover after tessellation"},
+  {"r-max",         'r', "500",   0, "The maximum distance that is visible"},
+  {"repeat",        'R', "3",     0, "The number of repetitions of every stage"},
+  {"label",         'L', "",      0, "A label stored with the results, e.g. the commit"},
+  {"output",        'o', "-",     0, "The file the JSON results are written to, - for stdout"},
+  {0}
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+  struct arguments *args = (arguments *) (state->input);
+  switch (key) {
+    case 'n':
+      args->city.buildings = arg ? atoi(arg) : 20;
+      break;
+    case 'c':
+      args->city.courtyards = arg ? atof(arg) : 0.3;
+      break;
+    case 'z':
+      args->city.min_height = arg ? atof(arg) : 5;
+      break;
+    case 'Z':
+      args->city.max_height = arg ? atof(arg) : 60;
+      break;
+    case 't':
+      args->city.terrain = arg ? atof(arg) : 10;
+      break;
+    case 'T':
+      args->city.terrain_cells = arg ? atoi(arg) : 32;
+      break;
+    case 's':
+      args->city.seed = arg ? atoi(arg) : 1;
+      break;
+    case 'p':
+      args->points = arg ? atoi(arg) : 32;
+      break;
+    case 'b':
+      args->backends = arg;
+      break;
+    case 'm':
+      args->metrics = arg;
+      break;
+    case 'a':
+      args->alpha_max = arg ? atof(arg) : 0.1;
+      break;
+    case 'r':
+      args->r_max = arg ? atof(arg) : 500;
+      break;
+    case 'R':
+      args->repeat = arg ? std::max(1, atoi(arg)) : 3;
+      break;
+    case 'L':
+      args->label = arg;
+      break;
+    case 'o':
+      args->output = arg;
+      break;
+    case ARGP_KEY_ARG:
+      argp_usage(state);
+      break;
+    default:
+      return ARGP_ERR_UNKNOWN;
+  }
+  return 0;
+}
+
+std::vector<std::string> split(std::string list) {
+  std::vector<std::string> items = {};
+  std::istringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ','))
+    items.push_back(item);
+  return items;
+}
+
+/* Run the benchmark using arguments */
+int main(int argc, char **argv) {
+  struct arguments args;
+
+  /* Default values. */
+  args.city = {20, 30, 12, 5, 60, 0.3f, 10, 32, 1};
+  args.points = 32;
+  args.backends = "gpu,cpu";
+  args.metrics = "area,minradial,maxradial,volume,skyratio";
+  args.alpha_max = 0.1;
+  args.r_max = 500;
+  args.repeat = 3;
+  args.label = "";
+  args.output = "-";
+
+  /* Parse our arguments; every option seen by parse_opt will be
+     reflected in arguments. */
+  static struct argp argp = {options, parse_opt, args_doc, doc};
+  argp_parse(&argp, argc, argv, 0, 0, &args);
+
+  City city = generate_city(args.city);
+  std::string scene = to_geojson(city);
+  std::vector<quavis::vec3> points = observer_grid(args.city, city.extent, args.points);
+  std::vector<std::string> metrics = split(args.metrics);
+
+  json stages = json::object();
+
+  // parsing the scene, including the triangulation
+  std::vector<quavis::vec3> triangles;
+  stages["geojson_parse"] = measure(args.repeat, [&]() {
+    triangles = quavis::geojson::parse(scene);
+  });
+
+  // the triangulation alone
+  std::vector<std::vector<quavis::vec3>> polygons = {};
+  for (auto& feature : city.features) {
+    for (const Polygon& polygon : feature) {
+      polygons.push_back({});
+      for (const std::vector<quavis::vec3>& ring : polygon)
+        polygons.back().insert(polygons.back().end(), ring.begin(), ring.end());
+    }
+  }
+  stages["triangulate"] = measure(args.repeat, [&]() {
+    for (const std::vector<quavis::vec3>& polygon : polygons)
+      quavis::triangulation::triangulate(polygon);
+  });
+
+  // merging equal vertices into an index buffer, as done when uploading
+  size_t num_vertices = 0;
+  stages["vertex_dedupe"] = measure(args.repeat, [&]() {
+    std::unordered_map<quavis::Vertex, int> vertex_map = {};
+    std::vector<uint32_t> indices = {};
+    for (quavis::vec3 p : triangles) {
+      quavis::Vertex vertex = {p, {255,255,255}};
+      auto inserted = vertex_map.insert({vertex, (int) vertex_map.size()});
+      indices.push_back(inserted.first->second);
+    }
+    num_vertices = vertex_map.size();
+  });
+
+  json backends = json::object();
+  for (std::string backend : split(args.backends)) {
+    try {
+      backends[backend] = benchmark_backend(backend, scene, points, metrics, args.alpha_max, args.r_max, args.repeat);
+    }
+    catch (const char *what) {
+      backends[backend] = {{"error", what}};
+    }
+  }
+
+  json results = {
+    {"version", std::to_string(VERSION_MAJOR) + "." + std::to_string(VERSION_MINOR) + "." + std::to_string(VERSION_PATCH)},
+    {"label", args.label},
+    {"repeat", args.repeat},
+    {"scene", {
+      {"buildings", args.city.buildings * args.city.buildings},
+      {"courtyards", city.courtyards},
+      {"terrain_cells", args.city.terrain_cells * args.city.terrain_cells},
+      {"polygons", polygons.size()},
+      {"triangles", triangles.size() / 3},
+      {"vertices", num_vertices},
+      {"bytes", scene.size()},
+      {"seed", args.city.seed}
+    }},
+    {"points", points.size()},
+    {"metrics", metrics},
+    {"alpha_max", args.alpha_max},
+    {"r_max", args.r_max},
+    {"stages", stages},
+    {"backends", backends}
+  };
+
+  if (std::string(args.output) == "-") {
+    std::cout << results.dump(2) << std::endl;
+  } else {
+    std::ofstream file(args.output);
+    file << results.dump(2) << std::endl;
+  }
+}
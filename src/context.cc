@@ -1,46 +1,92 @@
 #include "quavis/quavis.h"
 #include <chrono>
 #include <cfloat>
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
 #include <unordered_map>
 #include <unordered_set>
+#include <map>
 
 using namespace quavis;
 
-Context::Context(std::string shader_name) {
-  this->shader_name_ = shader_name;
+Context::Context(std::string shader_name) : Context(std::vector<std::string>{shader_name}) {
+}
+
+Context::Context(std::vector<std::string> metrics, bool pipeline_statistics, std::string pipeline_cache_path)
+  : pipeline_cache_path_(pipeline_cache_path), pipeline_statistics_enabled_(pipeline_statistics) {
+  for (std::string name : metrics) {
+    Metric metric = {};
+    metric.name = name;
+    metric.render_mode = metric_render_mode(name);
+    this->metrics_.push_back(metric);
+    this->render_mode_required_[metric.render_mode] = true;
+  }
 
   this->InitializeVkInstance();
   this->InitializeVkPhysicalDevice();
   this->InitializeVkLogicalDevice();
+  this->allocator_ = std::unique_ptr<SubAllocator>(new SubAllocator(this->vk_physical_device_, this->vk_logical_device_));
   this->InitializeVkShaderModules();
   this->InitializeVkRenderPass();
   this->InitializeVkDescriptorPool();
   this->InitializeVkDescriptorSetLayout();
   this->InitializeVkGraphicsPipelineLayout();
   this->InitializeVkComputePipelineLayout();
+  this->InitializeVkPipelineCache();
   this->InitializeVkGraphicsPipeline();
   this->InitializeVkComputePipeline();
+  this->SavePipelineCache();
+  this->InitializeVkQueryPool();
+
+  // resources that do not depend on the scene
+  this->InitializeVkMemory();
+  this->InitializeVkImageLayouts();
+
+  VkDescriptorSetLayout layouts[] = {this->vk_graphics_descriptor_set_layout_};
+  this->CreateGraphicsDescriptorSet(layouts, &this->vk_graphics_descriptor_set_);
+  this->UpdateGraphicsDescriptorSet(sizeof(UniformBufferObject), this->vk_uniform_buffer_, &this->vk_graphics_descriptor_set_);
+
+  VkFenceCreateInfo fenceCreateInfo = {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, nullptr, 0x00000001};
+  debug::handleVkResult(vkCreateFence(this->vk_logical_device_,&fenceCreateInfo,nullptr,&this->vk_compute_fence_));
+  this->CreateComputeDescriptorSets();
+  this->UpdateComputeDescriptorSets();
+  this->InitializeVkComputeCommandBuffers();
+}
+
+std::vector<float> Context::Parse(const std::string& contents, vec3_span analysispoints, float alpha_max, float r_max) {
+  std::string metric = this->metrics_[0].name;
+  return this->Parse(contents, analysispoints, alpha_max, r_max, std::vector<std::string>{metric})[metric];
 }
 
-std::vector<float> Context::Parse(std::string contents, std::vector<vec3> analysispoints, float alpha_max, float r_max) {
+std::map<std::string, std::vector<float>> Context::Parse(const std::string& contents, vec3_span analysispoints, float alpha_max, float r_max, std::vector<std::string> metrics, std::function<bool()> cancelled) {
+  // the requested metrics and the render modes they need
+  std::vector<size_t> requested = {};
+  bool render_mode_used[RENDER_MODE_COUNT] = {false, false};
+  for (std::string name : metrics) {
+    size_t m = this->GetMetricIndex(name);
+    requested.push_back(m);
+    render_mode_used[this->metrics_[m].render_mode] = true;
+  }
+
   this->uniform_.alpha_max = alpha_max;
   this->uniform_.r_max = r_max;
-  std::vector<vec3> points = geojson::parse(contents);
-  std::unordered_map<Vertex, int> vertex_map = {};
-  vertices_ = std::vector<Vertex>();
-  for (uint32_t i = 0; i < points.size(); i++) {
-    Vertex vertex = {points[i], {255,255,255}};
-    if (vertex_map.count(vertex) == 0) {
-      vertex_map[vertex] = vertices_.size();
-      vertices_.push_back(vertex);
-    }
-    indices_.push_back(vertex_map[vertex]);
-  }
+  this->stage_times_ = {};
+  if (this->timestamp_valid_bits_ > 0)
+    for (const char *name : timestamp_stage_names)
+      this->stage_times_[name] = 0.0;
 
-  this->InitializeVkMemory();
-  this->InitializeVkImageLayouts();
+  // device spans are traced on the host's clock
+  if (trace::current())
+    this->CalibrateTimestamps();
+
+  auto start = std::chrono::steady_clock::now();
+  this->LoadScene(contents, r_max);
+  std::chrono::duration<double> load_time = std::chrono::steady_clock::now() - start;
+  this->stage_times_["load_scene"] = load_time.count();
+  start = std::chrono::steady_clock::now();
 
-  std::vector<vec3> observation_points = analysispoints;
+  vec3_span observation_points = analysispoints;
 
   //// Create a list of vertices that lie are in some triangle
   //std::unordered_set<size_t> ignore = {};
@@ -53,66 +99,244 @@ std::vector<float> Context::Parse(std::string contents, std::vector<vec3> analys
   //  }
   //}
 
-  this->SubmitVertexData();
-  this->SubmitIndexData();
   this->SubmitUniformData();
 
-  VkDescriptorSetLayout layouts[] = {this->vk_graphics_descriptor_set_layout_};
-  this->CreateGraphicsDescriptorSet(layouts, &this->vk_graphics_descriptor_set_);
-  this->UpdateGraphicsDescriptorSet(sizeof(UniformBufferObject), this->vk_uniform_buffer_, &this->vk_graphics_descriptor_set_);
-  this->InitializeVkGraphicsCommandBuffers();
-
-  VkFenceCreateInfo fenceCreateInfo = {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, nullptr, 0x00000001};
-  debug::handleVkResult(vkCreateFence(this->vk_logical_device_,&fenceCreateInfo,nullptr,&this->vk_compute_fence_));
-  this->CreateComputeDescriptorSets();
-  this->UpdateComputeDescriptorSets();
-  this->InitializeVkComputeCommandBuffers();
+  // Observation points are processed grouped by their tile. All observers of
+  // a group share the same set of visible tiles, so the draw command buffer
+  // only has to be re-recorded when moving on to the next group.
+  std::vector<size_t> order = tiling::sort_by_cell(this->grid_, observation_points);
+  bool recorded = false;
 
   // MAGIIC
-  std::vector<float> results(observation_points.size());
-  for (size_t i = 0; i < observation_points.size(); i++) {
-    this->uniform_.observation_point = observation_points[i];
-    this->SubmitUniformData();
-    vkQueueWaitIdle(this->vk_queue_graphics_);
-    this->VkDraw();
-    this->ResetResult();
-    vkQueueWaitIdle(this->vk_queue_graphics_);
-    this->VkCompute();
-    vkQueueWaitIdle(this->vk_queue_compute_);
-    results[i] = *(float*)this->RetrieveResult();
-
-    if (imagesRequired) {
-      RetrieveRenderImage(i);
-      RetrieveDepthImage(i);
-      //RetrieveComputeImage(i);
+  std::map<std::string, std::vector<float>> results;
+  for (size_t m : requested)
+    results[this->metrics_[m].name] = std::vector<float>(observation_points.size());
+  this->primitive_counts_ = std::vector<uint64_t>(this->pipeline_statistics_supported_ ? observation_points.size() : 0);
+  this->pipeline_statistics_ = {};
+  if (this->pipeline_statistics_supported_)
+    for (const char *name : pipeline_statistic_names)
+      this->pipeline_statistics_[name] = 0;
+  for (size_t begin = 0, end = 0; begin < order.size(); begin = end) {
+    uint32_t cell = this->grid_.cell(observation_points[order[begin]]);
+    vec3 group_min = observation_points[order[begin]];
+    vec3 group_max = group_min;
+    for (end = begin; end < order.size() && this->grid_.cell(observation_points[order[end]]) == cell; end++) {
+      group_min = tiling::min(group_min, observation_points[order[end]]);
+      group_max = tiling::max(group_max, observation_points[order[end]]);
+    }
+
+    std::vector<float> lod_distances(this->lod_distances_.size());
+    for (size_t l = 0; l < lod_distances.size(); l++)
+      lod_distances[l] = this->lod_distances_[l] * r_max;
+
+    trace::Span span("observers", "isovists", {{"count", end - begin}, {"cell", cell}});
+    std::vector<tiling::DrawRange> draw_ranges = tiling::select(this->tiles_, group_min, group_max, r_max, lod_distances);
+    if (!recorded || draw_ranges != this->draw_ranges_) {
+      trace::Span span("record commands", "isovists");
+      vkQueueWaitIdle(this->vk_queue_graphics_);
+      this->draw_ranges_ = draw_ranges;
+      for (size_t mode = 0; mode < RENDER_MODE_COUNT; mode++)
+        if (render_mode_used[mode])
+          this->RecordGraphicsCommandBuffer((RenderMode)mode);
+      recorded = true;
+    }
+
+    for (size_t k = begin; k < end; k++) {
+      if (cancelled && cancelled()) {
+        // nothing may be in flight when the next call reuses the buffers
+        vkQueueWaitIdle(this->vk_queue_graphics_);
+        vkQueueWaitIdle(this->vk_queue_compute_);
+        throw Cancelled();
+      }
+
+      size_t i = order[k];
+      this->uniform_.observation_point = observation_points[i];
+      this->SubmitUniformData();
+
+      // render once per render mode and compute all metrics on that image
+      for (size_t mode = 0; mode < RENDER_MODE_COUNT; mode++) {
+        if (!render_mode_used[mode])
+          continue;
+
+        vkQueueWaitIdle(this->vk_queue_graphics_);
+        this->VkDraw((RenderMode)mode);
+        for (size_t m : requested) {
+          if (this->metrics_[m].render_mode != mode)
+            continue;
+          this->ResetResult();
+          vkQueueWaitIdle(this->vk_queue_graphics_);
+          this->VkCompute(m);
+          vkQueueWaitIdle(this->vk_queue_compute_);
+          this->RetrieveTimestamp(TIMESTAMP_REDUCE);
+          float* result = (float*)this->RetrieveResult();
+          results[this->metrics_[m].name][i] = *result;
+          free(result);
+        }
+        this->RetrieveTimestamp(TIMESTAMP_DRAW);
+        if (this->pipeline_statistics_supported_) {
+          uint64_t statistics[PIPELINE_STATISTIC_COUNT];
+          this->RetrievePipelineStatistics((RenderMode)mode, statistics);
+          this->primitive_counts_[i] += statistics[PIPELINE_STATISTIC_GEOMETRY_SHADER_INVOCATIONS];
+          for (size_t s = 0; s < PIPELINE_STATISTIC_COUNT; s++)
+            this->pipeline_statistics_[pipeline_statistic_names[s]] += statistics[s];
+        }
+      }
+
+      if (imagesRequired) {
+        RetrieveRenderImage(i);
+        RetrieveDepthImage(i);
+        //RetrieveComputeImage(i);
+      }
     }
   }
+
+  std::chrono::duration<double> observers_time = std::chrono::steady_clock::now() - start;
+  this->stage_times_["observers"] = observers_time.count();
   return results;
 }
 
+std::vector<uint64_t> Context::GetPrimitiveCounts() {
+  return this->primitive_counts_;
+}
+
+std::map<std::string, uint64_t> Context::GetPipelineStatistics() {
+  return this->pipeline_statistics_;
+}
+
+std::map<std::string, double> Context::GetStageTimes() {
+  return this->stage_times_;
+}
+
+uint64_t Context::GetDeviceMemory() {
+  return this->allocator_->GetAllocatedBytes();
+}
+
+size_t Context::GetMetricIndex(std::string name) {
+  for (size_t m = 0; m < this->metrics_.size(); m++)
+    if (this->metrics_[m].name == name)
+      return m;
+  throw "Metric not supported by this context.";
+}
+
+void Context::LoadScene(const std::string& contents, float r_max) {
+  // the uploaded scene (and its tiling, which depends on r_max) is kept
+  // between calls on the same scenario
+  if (this->scene_loaded_ && this->scene_r_max_ == r_max && this->scene_contents_ == contents)
+    return;
+
+  if (this->scene_loaded_) {
+    vkDeviceWaitIdle(this->vk_logical_device_);
+    this->DestroyVkSceneMemory();
+    this->scene_loaded_ = false;
+  }
+
+  trace::Span span("load scene", "scene");
+  this->InitializeTiles(geojson::parse_features(contents), r_max);
+  trace::Span upload_span("upload scene", "scene", {{"vertices", this->vertices_.size()}, {"indices", this->indices_.size()}});
+  this->InitializeVkSceneMemory();
+  this->SubmitVertexData();
+  this->SubmitIndexData();
+
+  this->scene_contents_ = contents;
+  this->scene_r_max_ = r_max;
+  this->scene_loaded_ = true;
+}
+
+void Context::InitializeTiles(std::vector<std::vector<vec3>> features, float r_max) {
+  trace::Span span("tiling", "scene", {{"features", features.size()}});
+  this->vertices_ = std::vector<Vertex>();
+  this->indices_ = std::vector<uint32_t>();
+  this->tiles_ = std::vector<tiling::Tile>();
+
+  // bounding boxes of features and scene
+  std::vector<vec3> feature_min(features.size()), feature_max(features.size());
+  vec3 scene_min = {0, 0, 0}, scene_max = {0, 0, 0};
+  for (size_t f = 0; f < features.size(); f++) {
+    tiling::bounds(features[f], feature_min[f], feature_max[f]);
+    scene_min = f == 0 ? feature_min[f] : tiling::min(scene_min, feature_min[f]);
+    scene_max = f == 0 ? feature_max[f] : tiling::max(scene_max, feature_max[f]);
+  }
+
+  // assign every feature to the tile containing the center of its bounding box
+  this->grid_ = tiling::make_grid(scene_min, scene_max, r_max * this->tile_size_, this->max_tiles_per_axis_);
+  std::vector<std::vector<size_t>> tile_features(this->grid_.size());
+  for (size_t f = 0; f < features.size(); f++) {
+    vec3 center = (feature_min[f] + feature_max[f]) * 0.5f;
+    tile_features[this->grid_.cell(center)].push_back(f);
+  }
+
+  std::vector<uint32_t> cells = {};
+  for (uint32_t c = 0; c < this->grid_.size(); c++) {
+    if (tile_features[c].empty())
+      continue;
+
+    tiling::Tile tile = {{}, feature_min[tile_features[c][0]], feature_max[tile_features[c][0]]};
+    for (size_t f : tile_features[c]) {
+      tile.min = tiling::min(tile.min, feature_min[f]);
+      tile.max = tiling::max(tile.max, feature_max[f]);
+    }
+    this->tiles_.push_back(tile);
+    cells.push_back(c);
+  }
+
+  // levels of detail: the exact geometry and a hull per building-like
+  // feature, all other features stay exact. The hulls are drawn from
+  // lod_distances_[0] * r_max on, where a pixel spans tolerance.
+  float tolerance = this->lod_distances_[0] * r_max * std::min(2 * (float)M_PI / this->render_width_, (float)M_PI / this->render_height_);
+  std::vector<std::vector<std::vector<vec3>>> levels = {features, {}};
+  std::vector<bool> simplified(this->tiles_.size(), false);
+  for (size_t f = 0; f < features.size(); f++)
+    levels[1].push_back(lod::simplify(features[f], feature_min[f].z, feature_max[f].z, tolerance));
+  for (size_t t = 0; t < this->tiles_.size(); t++) {
+    for (size_t f : tile_features[cells[t]])
+      simplified[t] = simplified[t] || levels[1][f].size() < features[f].size();
+  }
+
+  // write the triangles level by level and tile by tile, such that each
+  // level of a tile is a contiguous range of indices. Tiles without
+  // simplified features have no second level.
+  trace::Span dedupe_span("dedupe vertices", "scene");
+  std::unordered_map<Vertex, int> vertex_map = {};
+  for (size_t l = 0; l < levels.size(); l++) {
+    for (size_t t = 0; t < this->tiles_.size(); t++) {
+      if (l > 0 && !simplified[t])
+        continue;
+      tiling::DrawRange range = {(uint32_t)this->indices_.size(), 0};
+      for (size_t f : tile_features[cells[t]]) {
+        for (uint32_t i = 0; i < levels[l][f].size(); i++) {
+          Vertex vertex = {levels[l][f][i], {255,255,255}};
+          if (vertex_map.count(vertex) == 0) {
+            vertex_map[vertex] = vertices_.size();
+            vertices_.push_back(vertex);
+          }
+          indices_.push_back(vertex_map[vertex]);
+        }
+      }
+      range.index_count = this->indices_.size() - range.first_index;
+      this->tiles_[t].levels.push_back(range);
+    }
+  }
+}
+
 Context::~Context() {
   debug::handleVkResult(vkDeviceWaitIdle(this->vk_logical_device_));
 
+  // free the scene
+  if (this->scene_loaded_)
+    this->DestroyVkSceneMemory();
+
   // free all allocated memory
-  vkFreeMemory(this->vk_logical_device_, this->vk_color_image_memory_, nullptr);
-  vkFreeMemory(this->vk_logical_device_, this->vk_depth_stencil_image_memory_, nullptr);
-  vkFreeMemory(this->vk_logical_device_, this->vk_color_staging_image_memory_, nullptr);
-  vkFreeMemory(this->vk_logical_device_, this->vk_depth_stencil_staging_image_memory_, nullptr);
-  vkFreeMemory(this->vk_logical_device_, this->vk_vertex_buffer_memory_, nullptr);
-  vkFreeMemory(this->vk_logical_device_, this->vk_vertex_staging_buffer_memory_, nullptr);
-  vkFreeMemory(this->vk_logical_device_, this->vk_index_buffer_memory_, nullptr);
-  vkFreeMemory(this->vk_logical_device_, this->vk_index_staging_buffer_memory_, nullptr);
-  vkFreeMemory(this->vk_logical_device_, this->vk_uniform_buffer_memory_, nullptr);
-  vkFreeMemory(this->vk_logical_device_, this->vk_uniform_staging_buffer_memory_, nullptr);
-  vkFreeMemory(this->vk_logical_device_, this->vk_compute_tmp_buffer_memory_, nullptr);
-  vkFreeMemory(this->vk_logical_device_, this->vk_compute_buffer_memory_, nullptr);
-  vkFreeMemory(this->vk_logical_device_, this->vk_compute_staging_buffer_memory_, nullptr);
-
-  // destroy vertex buffer
-  vkDestroyBuffer(this->vk_logical_device_, this->vk_vertex_buffer_, nullptr);
-  vkDestroyBuffer(this->vk_logical_device_, this->vk_vertex_staging_buffer_, nullptr);
-  vkDestroyBuffer(this->vk_logical_device_, this->vk_index_buffer_, nullptr);
-  vkDestroyBuffer(this->vk_logical_device_, this->vk_index_staging_buffer_, nullptr);
+  this->FreeMemory(this->vk_color_image_memory_);
+  this->FreeMemory(this->vk_depth_stencil_image_memory_);
+  this->FreeMemory(this->vk_color_staging_image_memory_);
+  this->FreeMemory(this->vk_depth_stencil_staging_image_memory_);
+  this->FreeMemory(this->vk_uniform_buffer_memory_);
+  this->FreeMemory(this->vk_uniform_staging_buffer_memory_);
+  this->FreeMemory(this->vk_compute_tmp_buffer_memory_);
+  this->FreeMemory(this->vk_compute_buffer_memory_);
+  this->FreeMemory(this->vk_compute_staging_buffer_memory_);
+
+  // destroy buffers
   vkDestroyBuffer(this->vk_logical_device_, this->vk_uniform_buffer_, nullptr);
   vkDestroyBuffer(this->vk_logical_device_, this->vk_uniform_staging_buffer_, nullptr);
   vkDestroyBuffer(this->vk_logical_device_, this->vk_compute_tmp_buffer_, nullptr);
@@ -132,12 +356,19 @@ Context::~Context() {
   // destroy fences
   vkDestroyFence(this->vk_logical_device_, this->vk_compute_fence_, nullptr);
 
+  // destroy query pools
+  if (this->vk_statistics_query_pool_ != VK_NULL_HANDLE)
+    vkDestroyQueryPool(this->vk_logical_device_, this->vk_statistics_query_pool_, nullptr);
+  if (this->vk_timestamp_query_pool_ != VK_NULL_HANDLE)
+    vkDestroyQueryPool(this->vk_logical_device_, this->vk_timestamp_query_pool_, nullptr);
+
   // destroy framebuffer
   vkDestroyFramebuffer(this->vk_logical_device_, this->vk_graphics_framebuffer_, nullptr);
 
   // free command buffer
-  vkFreeCommandBuffers(this->vk_logical_device_, this->vk_graphics_command_pool_, 1, &this->vk_graphics_commandbuffer_);
-  vkFreeCommandBuffers(this->vk_logical_device_, this->vk_compute_command_pool_, 1, &this->vk_compute_commandbuffer_);
+  vkFreeCommandBuffers(this->vk_logical_device_, this->vk_graphics_command_pool_, RENDER_MODE_COUNT, this->vk_graphics_commandbuffers_);
+  for (Metric& metric : this->metrics_)
+    vkFreeCommandBuffers(this->vk_logical_device_, this->vk_compute_command_pool_, 1, &metric.commandbuffer);
 
   // destroy command pool
   vkDestroyCommandPool(this->vk_logical_device_, this->vk_graphics_command_pool_, nullptr);
@@ -153,10 +384,13 @@ Context::~Context() {
 
   // destroy pipeline
   vkDestroyPipelineLayout(this->vk_logical_device_, this->vk_graphics_pipeline_layout_, nullptr);
-  vkDestroyPipeline(this->vk_logical_device_, this->vk_graphics_pipeline_, nullptr);
+  for (size_t mode = 0; mode < RENDER_MODE_COUNT; mode++)
+    if (this->vk_graphics_pipelines_[mode] != VK_NULL_HANDLE)
+      vkDestroyPipeline(this->vk_logical_device_, this->vk_graphics_pipelines_[mode], nullptr);
   vkDestroyPipelineLayout(this->vk_logical_device_, this->vk_compute_pipeline_layout_, nullptr);
-  vkDestroyPipeline(this->vk_logical_device_, this->vk_compute_pipeline_, nullptr);
-  vkDestroyPipeline(this->vk_logical_device_, this->vk_compute_pipeline_2_, nullptr);
+  for (Metric& metric : this->metrics_)
+    vkDestroyPipeline(this->vk_logical_device_, metric.pipeline, nullptr);
+  vkDestroyPipelineCache(this->vk_logical_device_, this->vk_pipeline_cache_, nullptr);
 
   // destroy shaders
   vkDestroyShaderModule(this->vk_logical_device_, this->vk_vertex_shader_, nullptr);
@@ -164,11 +398,12 @@ Context::~Context() {
   vkDestroyShaderModule(this->vk_logical_device_, this->vk_tessellation_evaluation_shader_, nullptr);
   vkDestroyShaderModule(this->vk_logical_device_, this->vk_geoemtry_shader_, nullptr);
   vkDestroyShaderModule(this->vk_logical_device_, this->vk_fragment_shader_, nullptr);
-  vkDestroyShaderModule(this->vk_logical_device_, this->vk_compute_shader_, nullptr);
-  vkDestroyShaderModule(this->vk_logical_device_, this->vk_compute_shader_2_, nullptr);
+  for (Metric& metric : this->metrics_)
+    vkDestroyShaderModule(this->vk_logical_device_, metric.shader, nullptr);
 
   // destroy logical device
   vkDeviceWaitIdle(this->vk_logical_device_);
+  this->allocator_.reset();
   vkDestroyDevice(this->vk_logical_device_, nullptr);
 
   // destroy instance
@@ -185,7 +420,7 @@ void Context::InitializeVkInstance() {
     version, // quavis version
     "Quavis", // engine name
     version, // engine version,
-    VK_API_VERSION_1_0 // vk version
+    VK_API_VERSION_1_1 // vk version (1.1 for subgroup operations)
   };
 
   // TODO: Check if debug during instance creation and add glfw extension
@@ -344,6 +579,29 @@ void Context::InitializeVkPhysicalDevice() {
       device_it = devices_set.erase(device_it);
       continue;
     }
+
+    /////////////////// BEGIN CHECK SUBGROUP SUPPORT
+    // the compute shaders reduce with subgroup arithmetic (Vulkan 1.1)
+    VkPhysicalDeviceProperties device_properties;
+    vkGetPhysicalDeviceProperties(*device_it, &device_properties);
+    if (device_properties.apiVersion < VK_API_VERSION_1_1) {
+      device_it = devices_set.erase(device_it);
+      continue;
+    }
+
+    VkPhysicalDeviceSubgroupProperties subgroup_properties = {};
+    subgroup_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+    VkPhysicalDeviceProperties2 device_properties2 = {};
+    device_properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    device_properties2.pNext = &subgroup_properties;
+    vkGetPhysicalDeviceProperties2(*device_it, &device_properties2);
+
+    VkSubgroupFeatureFlags required_operations = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+    if (!(subgroup_properties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT)
+        || (subgroup_properties.supportedOperations & required_operations) != required_operations) {
+      device_it = devices_set.erase(device_it);
+      continue;
+    }
     /////////////////// END REQUIREMENT CHECK
     device_it++;
   }
@@ -397,6 +655,12 @@ void Context::InitializeVkLogicalDevice() {
     this->queue_family_index_++;
   }
 
+  // all queues are of the same family, the stages are timed if it has timestamps
+  VkPhysicalDeviceProperties device_properties;
+  vkGetPhysicalDeviceProperties(this->vk_physical_device_, &device_properties);
+  this->timestamp_valid_bits_ = queue_families[this->queue_family_index_].timestampValidBits;
+  this->timestamp_period_ = device_properties.limits.timestampPeriod;
+
   // Create graphics queue metadata
   // TODO: Seperate queue construction if multiple families are required
   float queue_family_priorities[] = { 1.0f, 1.0f, 1.0f };
@@ -411,12 +675,33 @@ void Context::InitializeVkLogicalDevice() {
 
   // Specify device features
   // TODO: Specify device features
+  VkPhysicalDeviceFeatures supported_features;
+  vkGetPhysicalDeviceFeatures(this->vk_physical_device_, &supported_features);
+  this->pipeline_statistics_supported_ = this->pipeline_statistics_enabled_ && supported_features.pipelineStatisticsQuery == VK_TRUE;
+
   VkPhysicalDeviceFeatures device_features = {};
+  device_features.pipelineStatisticsQuery = supported_features.pipelineStatisticsQuery;
   device_features.tessellationShader = VK_TRUE;
   device_features.geometryShader = VK_TRUE;
   device_features.fillModeNonSolid = VK_TRUE;
   device_features.shaderStorageImageExtendedFormats = VK_TRUE;
 
+  // Enable conservative rasterization if it is available and needed
+  std::vector<const char*> extension_names = this->vk_logical_device_extension_names_;
+  if (this->render_mode_required_[RENDER_MODE_NEAREST]) {
+    uint32_t extension_count;
+    vkEnumerateDeviceExtensionProperties(this->vk_physical_device_, nullptr, &extension_count, nullptr);
+    std::vector<VkExtensionProperties> available_extensions(extension_count);
+    vkEnumerateDeviceExtensionProperties(this->vk_physical_device_, nullptr, &extension_count, available_extensions.data());
+
+    for (VkExtensionProperties extension : available_extensions) {
+      if (strcmp(extension.extensionName, VK_EXT_CONSERVATIVE_RASTERIZATION_EXTENSION_NAME) == 0) {
+        this->conservative_rasterization_supported_ = true;
+        extension_names.push_back(VK_EXT_CONSERVATIVE_RASTERIZATION_EXTENSION_NAME);
+      }
+    }
+  }
+
   // Create lgocial device metadata
   VkDeviceCreateInfo device_create_info = {
     VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO, // sType (see documentation)
@@ -426,8 +711,8 @@ void Context::InitializeVkLogicalDevice() {
     &queue_create_info, // queue meta data
     0, // deprecated & ignored
     nullptr, // depcrecated & ignored
-    (uint32_t)this->vk_logical_device_extension_names_.size(), // enabled extensions
-    this->vk_logical_device_extension_names_.data(), // extension names
+    (uint32_t)extension_names.size(), // enabled extensions
+    extension_names.data(), // extension names
     &device_features // enabled device features
   };
 
@@ -467,46 +752,6 @@ void Context::InitializeVkLogicalDevice() {
 }
 
 void Context::InitializeVkShaderModules() {
-  uint32_t* comp_shader, *comp2_shader;
-  size_t comp_shader_length, comp2_shader_length;
-
-  if (this->shader_name_ == "volume") {
-    comp_shader = (uint32_t*)src_shaders_shader_volume_comp_spv;
-    comp_shader_length = src_shaders_shader_volume_comp_spv_len;
-    comp2_shader = (uint32_t*)src_shaders_shader_2_volume_comp_spv;
-    comp2_shader_length = src_shaders_shader_2_volume_comp_spv_len;
-  }
-  else if (this->shader_name_ == "minradial") {
-    comp_shader = (uint32_t*)src_shaders_shader_minradial_comp_spv;
-    comp_shader_length = src_shaders_shader_minradial_comp_spv_len;
-    comp2_shader = (uint32_t*)src_shaders_shader_2_minradial_comp_spv;
-    comp2_shader_length = src_shaders_shader_2_minradial_comp_spv_len;
-  }
-  else if (this->shader_name_ == "maxradial") {
-    comp_shader = (uint32_t*)src_shaders_shader_maxradial_comp_spv;
-    comp_shader_length = src_shaders_shader_maxradial_comp_spv_len;
-    comp2_shader = (uint32_t*)src_shaders_shader_2_maxradial_comp_spv;
-    comp2_shader_length = src_shaders_shader_2_maxradial_comp_spv_len;
-  }
-  else if (this->shader_name_ == "area") {
-    comp_shader = (uint32_t*)src_shaders_shader_area_comp_spv;
-    comp_shader_length = src_shaders_shader_area_comp_spv_len;
-    comp2_shader = (uint32_t*)src_shaders_shader_2_area_comp_spv;
-    comp2_shader_length = src_shaders_shader_2_area_comp_spv_len;
-  }
-  /*else if (this->shader_name_ == "direct_sunlight") {
-    comp_shader = (uint32_t*)src_shaders_shader_direct_sunlight_comp_spv;
-    comp_shader_length = src_shaders_shader_direct_sunlight_comp_spv_len;
-    comp2_shader = (uint32_t*)src_shaders_shader_2_direct_sunlight_comp_spv;
-    comp2_shader_length = src_shaders_shader_2_direct_sunlight_comp_spv_len;
-  }*/
-  else if (this->shader_name_ == "skyratio") {
-    comp_shader = (uint32_t*)src_shaders_shader_skyratio_comp_spv;
-    comp_shader_length = src_shaders_shader_skyratio_comp_spv_len;
-    comp2_shader = (uint32_t*)src_shaders_shader_2_skyratio_comp_spv;
-    comp2_shader_length = src_shaders_shader_2_skyratio_comp_spv_len;
-  }
-
   // create vertex shader
   VkShaderModuleCreateInfo vertex_shader_info = {
     VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO, // type (see documentation)
@@ -597,41 +842,52 @@ void Context::InitializeVkShaderModules() {
     )
   );
 
-  // create compute shader
-  VkShaderModuleCreateInfo compute_shader_info = {
-    VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO, // type (see documentation)
-    nullptr, // next (see documentation, must be null)
-    0, // flags (see documentation, must be 0)
-    comp_shader_length, // fragment shader size
-    (uint32_t*)comp_shader // fragment shader code
-  };
+  // create one compute shader per metric
+  for (Metric& metric : this->metrics_) {
+    uint32_t* comp_shader;
+    size_t comp_shader_length;
 
-  debug::handleVkResult(
-    vkCreateShaderModule(
-      this->vk_logical_device_, // the logical device
-      &compute_shader_info, // shader meta data
-      nullptr, // allocation callback (see documentation)
-      &this->vk_compute_shader_ // the allocated memory for the logical device
-    )
-  );
-
-  // create compute shader
-  VkShaderModuleCreateInfo compute_shader2_info = {
-    VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO, // type (see documentation)
-    nullptr, // next (see documentation, must be null)
-    0, // flags (see documentation, must be 0)
-    comp2_shader_length, // fragment shader size
-    (uint32_t*)comp2_shader // fragment shader code
-  };
+    if (metric.name == "volume") {
+      comp_shader = (uint32_t*)src_shaders_shader_volume_comp_spv;
+      comp_shader_length = src_shaders_shader_volume_comp_spv_len;
+    }
+    else if (metric.name == "minradial") {
+      comp_shader = (uint32_t*)src_shaders_shader_minradial_comp_spv;
+      comp_shader_length = src_shaders_shader_minradial_comp_spv_len;
+    }
+    else if (metric.name == "maxradial") {
+      comp_shader = (uint32_t*)src_shaders_shader_maxradial_comp_spv;
+      comp_shader_length = src_shaders_shader_maxradial_comp_spv_len;
+    }
+    else if (metric.name == "area") {
+      comp_shader = (uint32_t*)src_shaders_shader_area_comp_spv;
+      comp_shader_length = src_shaders_shader_area_comp_spv_len;
+    }
+    else if (metric.name == "skyratio") {
+      comp_shader = (uint32_t*)src_shaders_shader_skyratio_comp_spv;
+      comp_shader_length = src_shaders_shader_skyratio_comp_spv_len;
+    }
+    else {
+      throw "Unknown metric.";
+    }
 
-  debug::handleVkResult(
-    vkCreateShaderModule(
-      this->vk_logical_device_, // the logical device
-      &compute_shader2_info, // shader meta data
-      nullptr, // allocation callback (see documentation)
-      &this->vk_compute_shader_2_ // the allocated memory for the logical device
-    )
-  );
+    VkShaderModuleCreateInfo compute_shader_info = {
+      VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO, // type (see documentation)
+      nullptr, // next (see documentation, must be null)
+      0, // flags (see documentation, must be 0)
+      comp_shader_length, // fragment shader size
+      (uint32_t*)comp_shader // fragment shader code
+    };
+
+    debug::handleVkResult(
+      vkCreateShaderModule(
+        this->vk_logical_device_, // the logical device
+        &compute_shader_info, // shader meta data
+        nullptr, // allocation callback (see documentation)
+        &metric.shader // the allocated memory for the logical device
+      )
+    );
+  }
 }
 
 void Context::InitializeVkRenderPass() {
@@ -876,7 +1132,115 @@ void Context::InitializeVkComputePipelineLayout() {
   );
 }
 
+PipelineCacheHeader Context::GetPipelineCacheHeader() {
+  VkPhysicalDeviceIDProperties id_properties = {};
+  id_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+  VkPhysicalDeviceProperties2 device_properties = {};
+  device_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+  device_properties.pNext = &id_properties;
+  vkGetPhysicalDeviceProperties2(this->vk_physical_device_, &device_properties);
+
+  PipelineCacheHeader header = {};
+  memcpy(header.magic, "QVPC", 4);
+  header.version = 1;
+  header.vendor_id = device_properties.properties.vendorID;
+  header.device_id = device_properties.properties.deviceID;
+  header.driver_version = device_properties.properties.driverVersion;
+  memcpy(header.device_uuid, id_properties.deviceUUID, VK_UUID_SIZE);
+  memcpy(header.cache_uuid, device_properties.properties.pipelineCacheUUID, VK_UUID_SIZE);
+  return header;
+}
+
+void Context::InitializeVkPipelineCache() {
+  // a missing, broken or foreign file starts an empty cache
+  std::vector<char> data = {};
+  if (!this->pipeline_cache_path_.empty()) {
+    std::ifstream file(this->pipeline_cache_path_, std::ios::binary);
+    PipelineCacheHeader expected = this->GetPipelineCacheHeader();
+    PipelineCacheHeader header = {};
+    if (file && file.read((char *) &header, sizeof(header))) {
+      bool valid = memcmp(header.magic, expected.magic, 4) == 0
+        && header.version == expected.version
+        && header.vendor_id == expected.vendor_id
+        && header.device_id == expected.device_id
+        && header.driver_version == expected.driver_version
+        && memcmp(header.device_uuid, expected.device_uuid, VK_UUID_SIZE) == 0
+        && memcmp(header.cache_uuid, expected.cache_uuid, VK_UUID_SIZE) == 0;
+
+      // the data has to fill the rest of the file, a corrupt size must not
+      // be allocated
+      file.seekg(0, std::ios::end);
+      valid = valid && (uint64_t) file.tellg() == sizeof(header) + header.data_size;
+      file.seekg(sizeof(header));
+      if (valid) {
+        data.resize(header.data_size);
+        if (!file.read(data.data(), data.size()))
+          data.clear();
+      }
+      if (data.empty())
+        std::cout << "INFO: " << "Ignoring the pipeline cache " << this->pipeline_cache_path_ << ", it is incomplete or of another device or driver" << std::endl;
+    }
+  }
+
+  VkPipelineCacheCreateInfo pipeline_cache_info = {
+    VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO, // sType
+    nullptr, // next (see documentation, must be null)
+    0, // flags (see documentation, must be 0)
+    data.size(), // size of the initial data
+    data.empty() ? nullptr : data.data() // the initial data
+  };
+
+  debug::handleVkResult(
+    vkCreatePipelineCache(
+      this->vk_logical_device_, // the logical device
+      &pipeline_cache_info, // info
+      nullptr, // allocation callback
+      &this->vk_pipeline_cache_ // the created cache
+    )
+  );
+  this->pipeline_cache_loaded_size_ = data.size();
+}
+
+void Context::SavePipelineCache() {
+  if (this->pipeline_cache_path_.empty())
+    return;
+
+  size_t size = 0;
+  debug::handleVkResult(vkGetPipelineCacheData(this->vk_logical_device_, this->vk_pipeline_cache_, &size, nullptr));
+  if (size == this->pipeline_cache_loaded_size_)
+    return; // all pipelines were found in the file
+
+  std::vector<char> data(size);
+  debug::handleVkResult(vkGetPipelineCacheData(this->vk_logical_device_, this->vk_pipeline_cache_, &size, data.data()));
+  PipelineCacheHeader header = this->GetPipelineCacheHeader();
+  header.data_size = size;
+
+  // the contexts of all workers and services may write the file, each
+  // replaces it at once
+  std::string tmp = this->pipeline_cache_path_ + "." + std::to_string(getpid()) + "." + std::to_string((uintptr_t) this) + ".tmp";
+  {
+    std::ofstream file(tmp, std::ios::binary);
+    file.write((const char *) &header, sizeof(header));
+    file.write(data.data(), size);
+    if (!file) {
+      std::cout << "WARNING: " << "Could not write the pipeline cache " << tmp << std::endl;
+      std::remove(tmp.c_str());
+      return;
+    }
+  }
+  if (std::rename(tmp.c_str(), this->pipeline_cache_path_.c_str()) != 0) {
+    std::cout << "WARNING: " << "Could not write the pipeline cache " << this->pipeline_cache_path_ << std::endl;
+    std::remove(tmp.c_str());
+  }
+}
+
 void Context::InitializeVkGraphicsPipeline() {
+  for (size_t mode = 0; mode < RENDER_MODE_COUNT; mode++)
+    if (this->render_mode_required_[mode])
+      this->CreateGraphicsPipeline((RenderMode)mode, &this->vk_graphics_pipelines_[mode]);
+}
+
+void Context::CreateGraphicsPipeline(RenderMode mode, VkPipeline* pipeline) {
   // create pipeline shader stages
   VkPipelineShaderStageCreateInfo vertex_shader_stage_info = {
     VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, // sType (see documentation)
@@ -888,6 +1252,28 @@ void Context::InitializeVkGraphicsPipeline() {
     nullptr // VkSpecializationInfo (see documentation)
   };
 
+  // the tessellation control shader's width and height constants, which
+  // bound the subdivision by the pixel footprint
+  uint32_t resolution[] = {this->render_width_, this->render_height_};
+  VkSpecializationMapEntry resolution_entries[] = {
+    {
+      0, // constant id
+      0, // offset in the data
+      sizeof(uint32_t) // size of the constant
+    },
+    {
+      1, // constant id
+      sizeof(uint32_t), // offset in the data
+      sizeof(uint32_t) // size of the constant
+    }
+  };
+  VkSpecializationInfo tessellation_control_specialization_info = {
+    2, // number of map entries
+    resolution_entries, // map entries
+    sizeof(resolution), // data size
+    resolution // data
+  };
+
   VkPipelineShaderStageCreateInfo tessellation_control_shader_stage_info = {
     VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, // sType (see documentation)
     nullptr, // next (see documentation, must be null)
@@ -895,7 +1281,7 @@ void Context::InitializeVkGraphicsPipeline() {
     VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT, // stage flag
     this->vk_tessellation_control_shader_, // shader module
     "main", // the pipeline's name
-    nullptr // VkSpecializationInfo (see documentation)
+    &tessellation_control_specialization_info // VkSpecializationInfo (see documentation)
   };
 
   VkPipelineShaderStageCreateInfo tessellation_evaluation_shader_stage_info = {
@@ -908,6 +1294,20 @@ void Context::InitializeVkGraphicsPipeline() {
     nullptr // VkSpecializationInfo (see documentation)
   };
 
+  // the geometry shader's exact_min_distance constant
+  VkBool32 exact_min_distance = mode == RENDER_MODE_NEAREST ? VK_TRUE : VK_FALSE;
+  VkSpecializationMapEntry exact_min_distance_entry = {
+    0, // constant id
+    0, // offset in the data
+    sizeof(VkBool32) // size of the constant
+  };
+  VkSpecializationInfo geometry_specialization_info = {
+    1, // number of map entries
+    &exact_min_distance_entry, // map entries
+    sizeof(VkBool32), // data size
+    &exact_min_distance // data
+  };
+
   VkPipelineShaderStageCreateInfo geoemtry_shader_stage_info = {
     VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, // sType (see documentation)
     nullptr, // next (see documentation, must be null)
@@ -915,7 +1315,7 @@ void Context::InitializeVkGraphicsPipeline() {
     VK_SHADER_STAGE_GEOMETRY_BIT, // stage flag
     this->vk_geoemtry_shader_, // shader module
     "main", // the pipeline's name
-    nullptr // VkSpecializationInfo (see documentation)
+    &geometry_specialization_info // VkSpecializationInfo (see documentation)
   };
 
   VkPipelineShaderStageCreateInfo fragment_shader_stage_info = {
@@ -985,10 +1385,21 @@ void Context::InitializeVkGraphicsPipeline() {
     &scissor, // scissor
   };
 
+  // Rasterize every pixel touched by a primitive, such that thin geometry is
+  // never missed
+  VkPipelineRasterizationConservativeStateCreateInfoEXT conservative_info = {
+    VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_CONSERVATIVE_STATE_CREATE_INFO_EXT, // sType
+    nullptr, // next
+    0, // flags (see documentation, must be 0)
+    VK_CONSERVATIVE_RASTERIZATION_MODE_OVERESTIMATE_EXT, // conservative mode
+    0.0f // extra overestimation size
+  };
+  bool conservative = mode == RENDER_MODE_NEAREST && this->conservative_rasterization_supported_;
+
   // Define rasterizer
   VkPipelineRasterizationStateCreateInfo rasterizer_info = {
     VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO, // sType
-    nullptr, // next (see documentation, must be null)
+    conservative ? &conservative_info : nullptr, // next (conservative rasterization, if used)
     0, // flags (see documentation, must be 0)
     VK_FALSE, // depth clamping
     VK_FALSE, // discard primitives before rendering?
@@ -1088,111 +1499,105 @@ void Context::InitializeVkGraphicsPipeline() {
   debug::handleVkResult(
     vkCreateGraphicsPipelines(
       this->vk_logical_device_, // logical device
-      VK_NULL_HANDLE, // pipeline cache // TODO: Add pipeline cache (?)
+      this->vk_pipeline_cache_, // pipeline cache
       1, // pipeline count
       &pipeline_info, // pipeline infos
       nullptr, // allocation callback
-      &this->vk_graphics_pipeline_ // allocated memory for the pipeline
+      pipeline // allocated memory for the pipeline
     )
   );
 }
 
 
 void Context::InitializeVkComputePipeline() {
-  // create pipeline shader stages
-  VkPipelineShaderStageCreateInfo compute_shader_stage_info = {
-    VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, // sType (see documentation)
-    nullptr, // next (see documentation, must be null)
-    0, // flags (see documentation, must be 0)
-    VK_SHADER_STAGE_COMPUTE_BIT, // stage flag
-    this->vk_compute_shader_, // shader module
-    "main", // the pipeline's name
-    nullptr // VkSpecializationInfo (see documentation)
-  };
+  for (Metric& metric : this->metrics_) {
+    // create pipeline shader stages
+    VkPipelineShaderStageCreateInfo compute_shader_stage_info = {
+      VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, // sType (see documentation)
+      nullptr, // next (see documentation, must be null)
+      0, // flags (see documentation, must be 0)
+      VK_SHADER_STAGE_COMPUTE_BIT, // stage flag
+      metric.shader, // shader module
+      "main", // the pipeline's name
+      nullptr // VkSpecializationInfo (see documentation)
+    };
+
+    // Define pipeline info
+    VkComputePipelineCreateInfo pipeline_info = {
+      VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO, // sType
+      nullptr, // next (see documentation, must be null)
+      0, // pipeline create flags (have no child pipelines, so don't care)
+      compute_shader_stage_info, // shader stage create infos
+      this->vk_compute_pipeline_layout_,
+      VK_NULL_HANDLE,
+      -1 // parent pipeline index
+    };
+
+    debug::handleVkResult(
+      vkCreateComputePipelines(
+        this->vk_logical_device_, // logical device
+        this->vk_pipeline_cache_, // pipeline cache
+        1, // pipeline count
+        &pipeline_info, // pipeline infos
+        nullptr, // allocation callback
+        &metric.pipeline // allocated memory for the pipeline
+      )
+    );
+  }
+}
 
-  VkPipelineShaderStageCreateInfo compute_shader_2_stage_info = {
-    VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, // sType (see documentation)
-    nullptr, // next (see documentation, must be null)
-    0, // flags (see documentation, must be 0)
-    VK_SHADER_STAGE_COMPUTE_BIT, // stage flag
-    this->vk_compute_shader_2_, // shader module
-    "main", // the pipeline's name
-    nullptr // VkSpecializationInfo (see documentation)
-  };
+void Context::InitializeVkQueryPool() {
+  if (this->timestamp_valid_bits_ > 0) {
+    // a begin and an end timestamp per stage and one to calibrate traces
+    VkQueryPoolCreateInfo timestamp_pool_info = {
+      VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO, // sType
+      nullptr, // next (see documentation, must be null)
+      0, // flags (see documentation, must be 0)
+      VK_QUERY_TYPE_TIMESTAMP, // query type
+      2 * TIMESTAMP_COUNT + 1, // number of queries
+      0 // statistics (none for timestamps)
+    };
+
+    debug::handleVkResult(
+      vkCreateQueryPool(
+        this->vk_logical_device_, // the logical device
+        &timestamp_pool_info, // info
+        nullptr, // allocation callback
+        &this->vk_timestamp_query_pool_ // the allocated memory
+      )
+    );
+  }
 
-  // Define pipeline info
-  VkComputePipelineCreateInfo pipeline_info = {
-    VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO, // sType
-    nullptr, // next (see documentation, must be null)
-    0, // pipeline create flags (have no child pipelines, so don't care)
-    compute_shader_stage_info, // shader stage create infos
-    this->vk_compute_pipeline_layout_,
-    VK_NULL_HANDLE,
-    -1 // parent pipeline index
-  };
+  if (!this->pipeline_statistics_supported_)
+    return;
 
-  VkComputePipelineCreateInfo pipeline_info_2 = {
-    VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO, // sType
+  // the counters of PipelineStatistic, the device writes them ordered by
+  // their bits
+  VkQueryPoolCreateInfo query_pool_info = {
+    VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO, // sType
     nullptr, // next (see documentation, must be null)
-    0, // pipeline create flags (have no child pipelines, so don't care)
-    compute_shader_2_stage_info, // shader stage create infos
-    this->vk_compute_pipeline_layout_,
-    VK_NULL_HANDLE,
-    -1 // parent pipeline index
+    0, // flags (see documentation, must be 0)
+    VK_QUERY_TYPE_PIPELINE_STATISTICS, // query type
+    RENDER_MODE_COUNT, // number of queries (one per render mode)
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_GEOMETRY_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_GEOMETRY_SHADER_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_TESSELLATION_EVALUATION_SHADER_INVOCATIONS_BIT // statistics
   };
 
   debug::handleVkResult(
-    vkCreateComputePipelines(
-      this->vk_logical_device_, // logical device
-      VK_NULL_HANDLE, // pipeline cache // TODO: Add pipeline cache (?)
-      1, // pipeline count
-      &pipeline_info, // pipeline infos
-      nullptr, // allocation callback
-      &this->vk_compute_pipeline_ // allocated memory for the pipeline
-    )
-  );
-
-  debug::handleVkResult(
-    vkCreateComputePipelines(
-      this->vk_logical_device_, // logical device
-      VK_NULL_HANDLE, // pipeline cache // TODO: Add pipeline cache (?)
-      1, // pipeline count
-      &pipeline_info_2, // pipeline infos
+    vkCreateQueryPool(
+      this->vk_logical_device_, // the logical device
+      &query_pool_info, // info
       nullptr, // allocation callback
-      &this->vk_compute_pipeline_2_ // allocated memory for the pipeline
+      &this->vk_statistics_query_pool_ // the allocated memory
     )
   );
-
-
 }
 
 void Context::InitializeVkMemory() {
-  // vertex buffer
-  this->CreateBuffer(
-    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-    sizeof(this->vertices_[0]) * this->vertices_.size(),
-    &this->vk_vertex_buffer_, &this->vk_vertex_buffer_memory_);
-
-  this->CreateBuffer(
-    VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-    sizeof(this->vertices_[0]) * this->vertices_.size(),
-    &this->vk_vertex_staging_buffer_, &this->vk_vertex_staging_buffer_memory_);
-
-  // index buffer
-  this->CreateBuffer(
-    VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-    sizeof(this->indices_[0]) * this->indices_.size(),
-    &this->vk_index_buffer_, &this->vk_index_buffer_memory_);
-
-  this->CreateBuffer(
-    VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-    sizeof(this->indices_[0]) * this->indices_.size(),
-    &this->vk_index_staging_buffer_, &this->vk_index_staging_buffer_memory_);
-
   // uniform buffer
   this->CreateBuffer(
     VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
@@ -1210,7 +1615,7 @@ void Context::InitializeVkMemory() {
   this->CreateBuffer(
     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-    sizeof(float)*this->workgroups[0],
+    this->compute_tmp_size_,
     &this->vk_compute_tmp_buffer_, &this->vk_compute_tmp_buffer_memory_);
 
   this->CreateBuffer(
@@ -1268,19 +1673,61 @@ void Context::InitializeVkMemory() {
   // framebuffer
   this->CreateFrameBuffer();
 
-  // graphics command buffers
-  this->CreateCommandPool(&this->vk_graphics_command_pool_);
-  this->CreateCommandBuffer(this->vk_graphics_command_pool_, &this->vk_graphics_commandbuffer_);
+  // graphics command buffers (re-recorded whenever the visible tiles change)
+  this->CreateCommandPool(VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, &this->vk_graphics_command_pool_);
+  for (size_t mode = 0; mode < RENDER_MODE_COUNT; mode++)
+    this->CreateCommandBuffer(this->vk_graphics_command_pool_, &this->vk_graphics_commandbuffers_[mode]);
 
   // compute command buffers
-  this->CreateCommandPool(&this->vk_compute_command_pool_);
-  this->CreateCommandBuffer(this->vk_compute_command_pool_, &this->vk_compute_commandbuffer_);
-  this->CreateCommandBuffer(this->vk_compute_command_pool_, &this->vk_compute_commandbuffer_2_);
+  this->CreateCommandPool(0, &this->vk_compute_command_pool_);
+  for (Metric& metric : this->metrics_)
+    this->CreateCommandBuffer(this->vk_compute_command_pool_, &metric.commandbuffer);
+}
+
+void Context::InitializeVkSceneMemory() {
+  // vertex buffer
+  this->CreateBuffer(
+    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+    sizeof(this->vertices_[0]) * this->vertices_.size(),
+    &this->vk_vertex_buffer_, &this->vk_vertex_buffer_memory_);
+
+  this->CreateBuffer(
+    VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+    sizeof(this->vertices_[0]) * this->vertices_.size(),
+    &this->vk_vertex_staging_buffer_, &this->vk_vertex_staging_buffer_memory_);
+
+  // index buffer
+  this->CreateBuffer(
+    VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+    sizeof(this->indices_[0]) * this->indices_.size(),
+    &this->vk_index_buffer_, &this->vk_index_buffer_memory_);
+
+  this->CreateBuffer(
+    VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+    sizeof(this->indices_[0]) * this->indices_.size(),
+    &this->vk_index_staging_buffer_, &this->vk_index_staging_buffer_memory_);
+}
+
+void Context::DestroyVkSceneMemory() {
+  this->FreeMemory(this->vk_vertex_buffer_memory_);
+  this->FreeMemory(this->vk_vertex_staging_buffer_memory_);
+  this->FreeMemory(this->vk_index_buffer_memory_);
+  this->FreeMemory(this->vk_index_staging_buffer_memory_);
+  vkDestroyBuffer(this->vk_logical_device_, this->vk_vertex_buffer_, nullptr);
+  vkDestroyBuffer(this->vk_logical_device_, this->vk_vertex_staging_buffer_, nullptr);
+  vkDestroyBuffer(this->vk_logical_device_, this->vk_index_buffer_, nullptr);
+  vkDestroyBuffer(this->vk_logical_device_, this->vk_index_staging_buffer_, nullptr);
 }
 
 // RENDERING
 
-void Context::InitializeVkGraphicsCommandBuffers() {
+void Context::RecordGraphicsCommandBuffer(RenderMode mode) {
+  VkCommandBuffer commandbuffer = this->vk_graphics_commandbuffers_[mode];
+
   VkCommandBufferBeginInfo command_buffer_begin_info = {
     VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, // sType
     nullptr, // pNext (see documentation, must be null)
@@ -1290,7 +1737,7 @@ void Context::InitializeVkGraphicsCommandBuffers() {
 
   debug::handleVkResult(
     vkBeginCommandBuffer(
-      this->vk_graphics_commandbuffer_,
+      commandbuffer,
       &command_buffer_begin_info
     )
   );
@@ -1300,6 +1747,11 @@ void Context::InitializeVkGraphicsCommandBuffers() {
     {1.0f, 0.0f}
   };
 
+  // queries have to be reset outside of the render pass
+  if (this->pipeline_statistics_supported_)
+    vkCmdResetQueryPool(commandbuffer, this->vk_statistics_query_pool_, mode, 1);
+  this->BeginTimestamp(commandbuffer, TIMESTAMP_DRAW);
+
   VkRenderPassBeginInfo render_pass_info = {
     VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO, // sType
     nullptr, // pNext (see documentation, must be null)
@@ -1311,13 +1763,13 @@ void Context::InitializeVkGraphicsCommandBuffers() {
   };
 
   vkCmdBeginRenderPass(
-    this->vk_graphics_commandbuffer_, // command buffer
+    commandbuffer, // command buffer
     &render_pass_info, // render pass info
     VK_SUBPASS_CONTENTS_INLINE // store contents in primary command buffer
   );
 
   vkCmdPushConstants(
-     this->vk_graphics_commandbuffer_,
+     commandbuffer,
      this->vk_graphics_pipeline_layout_,
      VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_GEOMETRY_BIT,
      0,
@@ -1327,15 +1779,15 @@ void Context::InitializeVkGraphicsCommandBuffers() {
 
   // bind graphics pipeline
   vkCmdBindPipeline(
-    this->vk_graphics_commandbuffer_, // command buffer
+    commandbuffer, // command buffer
     VK_PIPELINE_BIND_POINT_GRAPHICS, // pipeline type
-    this->vk_graphics_pipeline_ // graphics pipeline
+    this->vk_graphics_pipelines_[mode] // graphics pipeline
   );
 
   // vertex data
   VkBuffer vertexBuffers[] = {this->vk_vertex_buffer_};
   VkDeviceSize offsets[] = {0};
-  vkCmdBindVertexBuffers(this->vk_graphics_commandbuffer_,
+  vkCmdBindVertexBuffers(commandbuffer,
     0, // vertex buffer binding index
     1, // number of bindings
     vertexBuffers, // vertex buffers
@@ -1344,7 +1796,7 @@ void Context::InitializeVkGraphicsCommandBuffers() {
 
   // uniform buffer object
   vkCmdBindDescriptorSets(
-    this->vk_graphics_commandbuffer_,
+    commandbuffer,
     VK_PIPELINE_BIND_POINT_GRAPHICS,
     this->vk_graphics_pipeline_layout_,
     0,
@@ -1354,124 +1806,88 @@ void Context::InitializeVkGraphicsCommandBuffers() {
     nullptr
   );
 
-  vkCmdBindIndexBuffer(this->vk_graphics_commandbuffer_, this->vk_index_buffer_, 0, VK_INDEX_TYPE_UINT32);
+  vkCmdBindIndexBuffer(commandbuffer, this->vk_index_buffer_, 0, VK_INDEX_TYPE_UINT32);
 
-  // draw
-  vkCmdDrawIndexed(
-    this->vk_graphics_commandbuffer_, // command buffer
-    this->indices_.size(), // num indexes
-    1, // num instances // TODO
-    0, // first index
-    0, // vertex index offset
-    0 // first instance
-  );
-
-  vkCmdEndRenderPass(this->vk_graphics_commandbuffer_);
+  if (this->pipeline_statistics_supported_)
+    vkCmdBeginQuery(commandbuffer, this->vk_statistics_query_pool_, mode, 0);
 
-  debug::handleVkResult(
-    vkEndCommandBuffer(
-      this->vk_graphics_commandbuffer_
-    )
-  );
-}
-
-void Context::InitializeVkComputeCommandBuffers() {
-  VkCommandBufferBeginInfo command_buffer_begin_info = {
-    VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, // sType
-    nullptr, // pNext (see documentation, must be null)
-    VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT, // can be submitted and run simultaniously
-    nullptr // VkCommandBufferInheritanceInfo (we don't need it)
-  };
-
-  debug::handleVkResult(
-    vkBeginCommandBuffer(
-      this->vk_compute_commandbuffer_,
-      &command_buffer_begin_info
-    )
-  );
-
-  vkCmdBindPipeline(
-    this->vk_compute_commandbuffer_,
-    VK_PIPELINE_BIND_POINT_COMPUTE,
-    this->vk_compute_pipeline_
-  );
-
-  std::vector<VkDescriptorSet> descriptor_sets = {
-    this->vk_compute_descriptor_set_
-  };
+  // draw all tiles that are visible from the current group of observers
+  for (tiling::DrawRange range : this->draw_ranges_) {
+    vkCmdDrawIndexed(
+      commandbuffer, // command buffer
+      range.index_count, // num indexes
+      1, // num instances // TODO
+      range.first_index, // first index
+      0, // vertex index offset
+      0 // first instance
+    );
+  }
 
-  vkCmdBindDescriptorSets(
-    this->vk_compute_commandbuffer_,
-    VK_PIPELINE_BIND_POINT_COMPUTE,
-    this->vk_compute_pipeline_layout_,
-    0,
-    descriptor_sets.size(),
-    descriptor_sets.data(),
-    0,
-    0
-  );
+  if (this->pipeline_statistics_supported_)
+    vkCmdEndQuery(commandbuffer, this->vk_statistics_query_pool_, mode);
 
-  vkCmdDispatch(
-    this->vk_compute_commandbuffer_,
-    this->workgroups[0],
-    this->workgroups[1],
-    this->workgroups[2]
-  );
+  vkCmdEndRenderPass(commandbuffer);
+  this->EndTimestamp(commandbuffer, TIMESTAMP_DRAW);
 
   debug::handleVkResult(
     vkEndCommandBuffer(
-      this->vk_compute_commandbuffer_
-    )
-  );
-
-  // next one
-  VkCommandBufferBeginInfo command_buffer_begin_info2 = {
-    VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, // sType
-    nullptr, // pNext (see documentation, must be null)
-    VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT, // can be submitted and run simultaniously
-    nullptr // VkCommandBufferInheritanceInfo (we don't need it)
-  };
-
-  debug::handleVkResult(
-    vkBeginCommandBuffer(
-      this->vk_compute_commandbuffer_2_,
-      &command_buffer_begin_info2
+      commandbuffer
     )
   );
+}
 
-  vkCmdBindPipeline(
-    this->vk_compute_commandbuffer_2_,
-    VK_PIPELINE_BIND_POINT_COMPUTE,
-    this->vk_compute_pipeline_2_
-  );
+void Context::InitializeVkComputeCommandBuffers() {
+  for (Metric& metric : this->metrics_) {
+    VkCommandBufferBeginInfo command_buffer_begin_info = {
+      VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, // sType
+      nullptr, // pNext (see documentation, must be null)
+      VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT, // can be submitted and run simultaniously
+      nullptr // VkCommandBufferInheritanceInfo (we don't need it)
+    };
+
+    debug::handleVkResult(
+      vkBeginCommandBuffer(
+        metric.commandbuffer,
+        &command_buffer_begin_info
+      )
+    );
 
-  std::vector<VkDescriptorSet> descriptor_sets_2 = {
-    this->vk_compute_descriptor_set_
-  };
+    this->BeginTimestamp(metric.commandbuffer, TIMESTAMP_REDUCE);
+    vkCmdBindPipeline(
+      metric.commandbuffer,
+      VK_PIPELINE_BIND_POINT_COMPUTE,
+      metric.pipeline
+    );
 
-  vkCmdBindDescriptorSets(
-    this->vk_compute_commandbuffer_2_,
-    VK_PIPELINE_BIND_POINT_COMPUTE,
-    this->vk_compute_pipeline_layout_,
-    0,
-    descriptor_sets_2.size(),
-    descriptor_sets_2.data(),
-    0,
-    0
-  );
+    std::vector<VkDescriptorSet> descriptor_sets = {
+      this->vk_compute_descriptor_set_
+    };
+
+    vkCmdBindDescriptorSets(
+      metric.commandbuffer,
+      VK_PIPELINE_BIND_POINT_COMPUTE,
+      this->vk_compute_pipeline_layout_,
+      0,
+      descriptor_sets.size(),
+      descriptor_sets.data(),
+      0,
+      0
+    );
 
-  vkCmdDispatch(
-    this->vk_compute_commandbuffer_2_,
-    this->workgroups2[0],
-    this->workgroups2[1],
-    this->workgroups2[2]
-  );
+    vkCmdDispatch(
+      metric.commandbuffer,
+      this->workgroups[0],
+      this->workgroups[1],
+      this->workgroups[2]
+    );
+    this->EndTimestamp(metric.commandbuffer, TIMESTAMP_REDUCE);
 
-  debug::handleVkResult(
-    vkEndCommandBuffer(
-      this->vk_compute_commandbuffer_2_
-    )
-  );
+    debug::handleVkResult(
+      vkEndCommandBuffer(
+        metric.commandbuffer
+      )
+    );
+  }
 }
 
 void Context::InitializeVkImageLayouts() {
@@ -1480,7 +1896,7 @@ void Context::InitializeVkImageLayouts() {
     this->TransformImageLayout(this->vk_color_staging_image_, VK_IMAGE_LAYOUT_PREINITIALIZED, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
 }
 
-void Context::VkDraw() {
+void Context::VkDraw(RenderMode mode) {
   // submit the graphics command buffer
   VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
 
@@ -1491,7 +1907,7 @@ void Context::VkDraw() {
     nullptr, // semaphore to wait for
     wait_stages, // stage until next semaphore is triggered
     1, //
-    &this->vk_graphics_commandbuffer_,
+    &this->vk_graphics_commandbuffers_[mode],
     0,
     nullptr
   };
@@ -1506,7 +1922,7 @@ void Context::VkDraw() {
   );
 }
 
-void Context::VkCompute() {
+void Context::VkCompute(size_t metric) {
   VkSubmitInfo submit_info = {
     VK_STRUCTURE_TYPE_SUBMIT_INFO, // sType,
     nullptr, // next (see documentaton, must be null)
@@ -1514,7 +1930,7 @@ void Context::VkCompute() {
     nullptr, // semaphore to wait for
     nullptr, // stage until next semaphore is triggered
     1, //
-    &this->vk_compute_commandbuffer_,
+    &this->metrics_[metric].commandbuffer,
     0,
     nullptr
   };
@@ -1528,30 +1944,6 @@ void Context::VkCompute() {
       this->vk_compute_fence_// fence (we don't need it)
     )
   );
-
-  vkQueueWaitIdle(this->vk_queue_compute_);
-
-  VkSubmitInfo submit_info2 = {
-    VK_STRUCTURE_TYPE_SUBMIT_INFO, // sType,
-    nullptr, // next (see documentaton, must be null)
-    0, // wait semaphore count
-    nullptr, // semaphore to wait for
-    nullptr, // stage until next semaphore is triggered
-    1, //
-    &this->vk_compute_commandbuffer_2_,
-    0,
-    nullptr
-  };
-
-  vkResetFences(this->vk_logical_device_, 1, &this->vk_compute_fence_);
-  debug::handleVkResult(
-    vkQueueSubmit(
-      this->vk_queue_compute_, // queue
-      1, // num infos
-      &submit_info2, // info
-      this->vk_compute_fence_// fence (we don't need it)
-    )
-  );
 }
 
 /// TRANSFER ROUTINES
@@ -1566,10 +1958,8 @@ void Context::SubmitVertexData() {
   );
   uint32_t buffersize = vertex_buffer_memory_requirements.size;
 
-  void* vertex_data;
-  vkMapMemory(this->vk_logical_device_, this->vk_vertex_staging_buffer_memory_, 0, buffersize, 0, &vertex_data);
+  void* vertex_data = this->vk_vertex_staging_buffer_memory_.mapped;
   memcpy(vertex_data, this->vertices_.data(), (size_t)buffersize);
-  vkUnmapMemory(this->vk_logical_device_, this->vk_vertex_staging_buffer_memory_);
 
   // copy from stating buffer to device local buffer
   VkCommandBuffer commandbuffer = this->BeginSingleTimeBuffer();
@@ -1578,9 +1968,12 @@ void Context::SubmitVertexData() {
   copyRegion.srcOffset = 0; // Optional
   copyRegion.dstOffset = 0; // Optional
   copyRegion.size = buffersize;
+  this->BeginTimestamp(commandbuffer, TIMESTAMP_SCENE_UPLOAD);
   vkCmdCopyBuffer(commandbuffer, this->vk_vertex_staging_buffer_, this->vk_vertex_buffer_, 1, &copyRegion);
+  this->EndTimestamp(commandbuffer, TIMESTAMP_SCENE_UPLOAD);
 
   this->EndSingleTimeBuffer(commandbuffer);
+  this->RetrieveTimestamp(TIMESTAMP_SCENE_UPLOAD);
 }
 
 void Context::SubmitIndexData() {
@@ -1593,10 +1986,8 @@ void Context::SubmitIndexData() {
   );
   uint32_t buffersize = buffer_memory_requirements.size;
 
-  void* vertex_data;
-  vkMapMemory(this->vk_logical_device_, this->vk_index_staging_buffer_memory_, 0, buffersize, 0, &vertex_data);
+  void* vertex_data = this->vk_index_staging_buffer_memory_.mapped;
   memcpy(vertex_data, this->indices_.data(), (size_t)buffersize);
-  vkUnmapMemory(this->vk_logical_device_, this->vk_index_staging_buffer_memory_);
 
   // copy from stating buffer to device local buffer
   VkCommandBuffer commandbuffer = this->BeginSingleTimeBuffer();
@@ -1605,9 +1996,12 @@ void Context::SubmitIndexData() {
   copyRegion.srcOffset = 0; // Optional
   copyRegion.dstOffset = 0; // Optional
   copyRegion.size = buffersize;
+  this->BeginTimestamp(commandbuffer, TIMESTAMP_SCENE_UPLOAD);
   vkCmdCopyBuffer(commandbuffer, this->vk_index_staging_buffer_, this->vk_index_buffer_, 1, &copyRegion);
+  this->EndTimestamp(commandbuffer, TIMESTAMP_SCENE_UPLOAD);
 
   this->EndSingleTimeBuffer(commandbuffer);
+  this->RetrieveTimestamp(TIMESTAMP_SCENE_UPLOAD);
 }
 
 void Context::SubmitUniformData() {
@@ -1620,10 +2014,8 @@ void Context::SubmitUniformData() {
   );
   uint32_t buffersize = buffer_memory_requirements.size;
 
-  void* vertex_data;
-  vkMapMemory(this->vk_logical_device_, this->vk_uniform_staging_buffer_memory_, 0, buffersize, 0, &vertex_data);
+  void* vertex_data = this->vk_uniform_staging_buffer_memory_.mapped;
   memcpy(vertex_data, &this->uniform_, (size_t)buffersize);
-  vkUnmapMemory(this->vk_logical_device_, this->vk_uniform_staging_buffer_memory_);
 
   // copy from stating buffer to device local buffer
   VkCommandBuffer commandbuffer = this->BeginSingleTimeBuffer();
@@ -1632,9 +2024,12 @@ void Context::SubmitUniformData() {
   copyRegion.srcOffset = 0; // Optional
   copyRegion.dstOffset = 0; // Optional
   copyRegion.size = buffersize;
+  this->BeginTimestamp(commandbuffer, TIMESTAMP_UPLOAD);
   vkCmdCopyBuffer(commandbuffer, this->vk_uniform_staging_buffer_, this->vk_uniform_buffer_, 1, &copyRegion);
+  this->EndTimestamp(commandbuffer, TIMESTAMP_UPLOAD);
 
   this->EndSingleTimeBuffer(commandbuffer);
+  this->RetrieveTimestamp(TIMESTAMP_UPLOAD);
 }
 
 void Context::RetrieveRenderImage(uint32_t i) {
@@ -1657,11 +2052,9 @@ void Context::RetrieveRenderImage(uint32_t i) {
     &host_visible_memory_requirements
   );
   size_t image_size = host_visible_memory_requirements.size;
-  void *data;
   void *pixels = malloc(image_size);
-  vkMapMemory(this->vk_logical_device_, this->vk_color_staging_image_memory_, 0, image_size, 0, (void **)&data);
+  void *data = this->vk_color_staging_image_memory_.mapped;
   memcpy(pixels, data, image_size);
-  vkUnmapMemory(this->vk_logical_device_, this->vk_color_staging_image_memory_);
   uint8_t image[this->render_width_ * this->render_height_];
   for (uint32_t i = 0; i < 4 * this->render_width_ * this->render_height_; i += 4) {
     float px;
@@ -1695,11 +2088,9 @@ void Context::RetrieveDepthImage(uint32_t i) {
     &host_visible_memory_requirements
   );
   size_t image_size = host_visible_memory_requirements.size;
-  void *data;
   void *pixels = malloc(image_size);
-  vkMapMemory(this->vk_logical_device_, this->vk_depth_stencil_staging_image_memory_, 0, image_size, 0, (void **)&data);
+  void *data = this->vk_depth_stencil_staging_image_memory_.mapped;
   memcpy(pixels, data, image_size);
-  vkUnmapMemory(this->vk_logical_device_, this->vk_depth_stencil_staging_image_memory_);
 
   uint8_t image[this->render_width_ * this->render_height_];
   for (uint32_t i = 0; i < 4 * this->render_width_ * this->render_height_; i += 4) {
@@ -1715,18 +2106,22 @@ void Context::RetrieveDepthImage(uint32_t i) {
 
 void Context::ResetResult() {
   // copy from stating buffer to device local buffer
-  void *data;
-  vkMapMemory(this->vk_logical_device_, this->vk_compute_staging_buffer_memory_, 0, this->compute_size_, 0, (void **)&data);
+  void *data = this->vk_compute_staging_buffer_memory_.mapped;
   memcpy(data, (void*)&this->compute_default_value_, this->compute_size_);
-  vkUnmapMemory(this->vk_logical_device_, this->vk_compute_staging_buffer_memory_);
 
   VkCommandBuffer commandbuffer = this->BeginSingleTimeBuffer();
   VkBufferCopy copyRegion = {};
   copyRegion.srcOffset = 0; // Optional
   copyRegion.dstOffset = 0; // Optional
   copyRegion.size = this->compute_size_;
+  this->BeginTimestamp(commandbuffer, TIMESTAMP_UPLOAD);
   vkCmdCopyBuffer(commandbuffer, this->vk_compute_staging_buffer_, this->vk_compute_buffer_, 1, &copyRegion);
+
+  // reset the counter of finished work groups (and the partial results)
+  vkCmdFillBuffer(commandbuffer, this->vk_compute_tmp_buffer_, 0, VK_WHOLE_SIZE, 0);
+  this->EndTimestamp(commandbuffer, TIMESTAMP_UPLOAD);
   this->EndSingleTimeBuffer(commandbuffer);
+  this->RetrieveTimestamp(TIMESTAMP_UPLOAD);
 }
 
 void* Context::RetrieveResult() {
@@ -1736,18 +2131,111 @@ void* Context::RetrieveResult() {
   copyRegion.srcOffset = 0; // Optional
   copyRegion.dstOffset = 0; // Optional
   copyRegion.size = this->compute_size_;
+  this->BeginTimestamp(commandbuffer, TIMESTAMP_READBACK);
   vkCmdCopyBuffer(commandbuffer, this->vk_compute_buffer_, this->vk_compute_staging_buffer_, 1, &copyRegion);
+  this->EndTimestamp(commandbuffer, TIMESTAMP_READBACK);
   this->EndSingleTimeBuffer(commandbuffer);
+  this->RetrieveTimestamp(TIMESTAMP_READBACK);
 
-  void *data;
   void *result = malloc(this->compute_size_);
-  vkMapMemory(this->vk_logical_device_, this->vk_compute_staging_buffer_memory_, 0, this->compute_size_, 0, (void **)&data);
+  void *data = this->vk_compute_staging_buffer_memory_.mapped;
   memcpy(result, data, this->compute_size_);
-  vkUnmapMemory(this->vk_logical_device_, this->vk_compute_staging_buffer_memory_);
 
   return result;
 }
 
+void Context::RetrievePipelineStatistics(RenderMode mode, uint64_t statistics[PIPELINE_STATISTIC_COUNT]) {
+  debug::handleVkResult(
+    vkGetQueryPoolResults(
+      this->vk_logical_device_, // the logical device
+      this->vk_statistics_query_pool_, // the query pool
+      mode, // first query
+      1, // number of queries
+      PIPELINE_STATISTIC_COUNT * sizeof(uint64_t), // size of the result data
+      statistics, // the result data
+      PIPELINE_STATISTIC_COUNT * sizeof(uint64_t), // stride between the queries
+      VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT // flags
+    )
+  );
+}
+
+void Context::BeginTimestamp(VkCommandBuffer commandbuffer, TimestampStage stage) {
+  if (this->timestamp_valid_bits_ == 0)
+    return;
+
+  // queries have to be reset before they are written again (outside of a render pass)
+  vkCmdResetQueryPool(commandbuffer, this->vk_timestamp_query_pool_, 2 * stage, 2);
+  vkCmdWriteTimestamp(commandbuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, this->vk_timestamp_query_pool_, 2 * stage);
+}
+
+void Context::EndTimestamp(VkCommandBuffer commandbuffer, TimestampStage stage) {
+  if (this->timestamp_valid_bits_ == 0)
+    return;
+
+  vkCmdWriteTimestamp(commandbuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, this->vk_timestamp_query_pool_, 2 * stage + 1);
+}
+
+void Context::RetrieveTimestamp(TimestampStage stage) {
+  if (this->timestamp_valid_bits_ == 0)
+    return;
+
+  // the stages are waited for before they are retrieved, such that this
+  // does not block
+  uint64_t timestamps[2] = {0, 0};
+  debug::handleVkResult(
+    vkGetQueryPoolResults(
+      this->vk_logical_device_, // the logical device
+      this->vk_timestamp_query_pool_, // the query pool
+      2 * stage, // first query
+      2, // number of queries
+      sizeof(timestamps), // size of the result data
+      timestamps, // the result data
+      sizeof(uint64_t), // stride between the queries
+      VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT // flags
+    )
+  );
+
+  uint64_t mask = this->timestamp_valid_bits_ >= 64 ? ~0ull : (1ull << this->timestamp_valid_bits_) - 1;
+  uint64_t ticks = ((timestamps[1] & mask) - (timestamps[0] & mask)) & mask;
+  this->stage_times_[timestamp_stage_names[stage]] += ticks * this->timestamp_period_ * 1e-9;
+
+  if (trace::current()) {
+    double begin = this->timestamp_offset_ + (timestamps[0] & mask) * this->timestamp_period_ * 1e-3;
+    trace::current()->Complete(timestamp_stage_names[stage], "device", begin, begin + ticks * this->timestamp_period_ * 1e-3, nlohmann::json::object(), Trace::DEVICE_THREAD);
+  }
+}
+
+void Context::CalibrateTimestamps() {
+  if (this->timestamp_valid_bits_ == 0)
+    return;
+
+  // the device writes the timestamp between submitting and the end of
+  // waiting for the buffer, its host time is taken as the middle of both
+  VkCommandBuffer commandbuffer = this->BeginSingleTimeBuffer();
+  vkCmdResetQueryPool(commandbuffer, this->vk_timestamp_query_pool_, 2 * TIMESTAMP_COUNT, 1);
+  vkCmdWriteTimestamp(commandbuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, this->vk_timestamp_query_pool_, 2 * TIMESTAMP_COUNT);
+  double submitted = Trace::Now();
+  this->EndSingleTimeBuffer(commandbuffer);
+  double finished = Trace::Now();
+
+  uint64_t timestamp = 0;
+  debug::handleVkResult(
+    vkGetQueryPoolResults(
+      this->vk_logical_device_, // the logical device
+      this->vk_timestamp_query_pool_, // the query pool
+      2 * TIMESTAMP_COUNT, // first query
+      1, // number of queries
+      sizeof(timestamp), // size of the result data
+      &timestamp, // the result data
+      sizeof(uint64_t), // stride between the queries
+      VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT // flags
+    )
+  );
+
+  uint64_t mask = this->timestamp_valid_bits_ >= 64 ? ~0ull : (1ull << this->timestamp_valid_bits_) - 1;
+  this->timestamp_offset_ = (submitted + finished) / 2 - (timestamp & mask) * this->timestamp_period_ * 1e-3;
+}
+
 void Context::RetrieveComputeImage(uint32_t i) {
   vkQueueWaitIdle(this->vk_queue_graphics_);
   vkWaitForFences(this->vk_logical_device_, 1, &this->vk_compute_fence_, VK_TRUE, UINT64_MAX);
@@ -1768,11 +2256,9 @@ void Context::RetrieveComputeImage(uint32_t i) {
     &host_visible_memory_requirements
   );
   size_t image_size = host_visible_memory_requirements.size;
-  void *data;
   void *pixels = malloc(image_size);
-  vkMapMemory(this->vk_logical_device_, this->vk_color_staging_image_memory_, 0, image_size, 0, (void **)&data);
+  void *data = this->vk_color_staging_image_memory_.mapped;
   memcpy(pixels, data, image_size);
-  vkUnmapMemory(this->vk_logical_device_, this->vk_color_staging_image_memory_);
 /*
   uint8_t image[this->render_width_ * this->render_height_];
   for (uint32_t i = 0; i < 4 * this->render_width_ * this->render_height_; i += 4) {
@@ -1789,7 +2275,11 @@ void Context::RetrieveComputeImage(uint32_t i) {
 
 /// CREATION ROUTINES
 
-void Context::CreateBuffer(VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryflags, uint32_t size, VkBuffer* buffer, VkDeviceMemory* buffer_memory) {
+void Context::FreeMemory(const Allocation& memory) {
+  this->allocator_->Free(memory);
+}
+
+void Context::CreateBuffer(VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryflags, uint32_t size, VkBuffer* buffer, Allocation* buffer_memory) {
   VkBufferCreateInfo bufferInfo = {};
   bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
   bufferInfo.size = size;
@@ -1803,40 +2293,15 @@ void Context::CreateBuffer(VkBufferUsageFlags usage, VkMemoryPropertyFlags memor
   VkMemoryRequirements memory_requirements;
   vkGetBufferMemoryRequirements(this->vk_logical_device_, *buffer, &memory_requirements);
 
-  // find suitible memor-type
-  uint32_t memory_type = 0;
-  uint32_t memory_type_bits = memory_requirements.memoryTypeBits;
-  VkPhysicalDeviceMemoryProperties physical_device_memory_properties;
-  vkGetPhysicalDeviceMemoryProperties(this->vk_physical_device_, &physical_device_memory_properties);
-  for (uint32_t i = 0; i < physical_device_memory_properties.memoryTypeCount; i++) {
-    if ((memory_type_bits & (1 << i)) && (physical_device_memory_properties.memoryTypes[i].propertyFlags & memoryflags) == memoryflags) {
-      memory_type = i;
-      break;
-    }
-  }
-
-  VkMemoryAllocateInfo allocation_info = {
-    VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, // sType
-    nullptr, // pNext (see documentation, must be null)
-    memory_requirements.size, // the memory size
-    memory_type // the memory type index
-  };
-
-  debug::handleVkResult(
-    vkAllocateMemory(
-      this->vk_logical_device_, // the logical devcie
-      &allocation_info, // the allocation info
-      nullptr, // allocation callback
-      buffer_memory // allocated memory for memory object
-    )
-  );
+  // the buffer gets a range of one of the allocator's arenas
+  *buffer_memory = this->allocator_->Allocate(memory_requirements, memoryflags, true);
 
   debug::handleVkResult(
     vkBindBufferMemory(
       this->vk_logical_device_, // the logical device
       *buffer, // the buffer
-      *buffer_memory, // the buffer memory
-      0 // the offset in the memory
+      buffer_memory->memory, // the buffer memory
+      buffer_memory->offset // the offset in the memory
     )
   );
 }
@@ -1905,7 +2370,7 @@ void Context::UpdateComputeDescriptorSets() {
   VkDescriptorBufferInfo buffer_tmp_info = {};
   buffer_tmp_info.buffer = this->vk_compute_tmp_buffer_;
   buffer_tmp_info.offset = 0;
-  buffer_tmp_info.range = sizeof(float)*this->workgroups[0];
+  buffer_tmp_info.range = this->compute_tmp_size_;
 
   std::vector<VkDescriptorImageInfo> in_infos = {
     image_in_info
@@ -1961,7 +2426,7 @@ void Context::UpdateComputeDescriptorSets() {
   vkUpdateDescriptorSets(this->vk_logical_device_, writedescriptor_sets.size(), writedescriptor_sets.data(), 0, nullptr);
 }
 
-void Context::CreateImage(VkFormat format, VkImageLayout layout, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags memoryflags, VkImage* image, VkDeviceMemory* image_memory) {
+void Context::CreateImage(VkFormat format, VkImageLayout layout, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags memoryflags, VkImage* image, Allocation* image_memory) {
   VkImageCreateInfo image_info = {
     VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO, // sType,
     nullptr, // pNext (see documentation, must be null)
@@ -1996,41 +2461,16 @@ void Context::CreateImage(VkFormat format, VkImageLayout layout, VkImageTiling t
     &memory_requirements
   );
 
-  // get the first set bit in the type-bits. This bit is at the index position
-  // of a supported memory type in the physical device
-  uint32_t memory_type = 0;
-  uint32_t memory_type_bits = memory_requirements.memoryTypeBits;
-  VkPhysicalDeviceMemoryProperties physical_device_memory_properties;
-    vkGetPhysicalDeviceMemoryProperties(this->vk_physical_device_, &physical_device_memory_properties);
-  for (uint32_t i = 0; i < physical_device_memory_properties.memoryTypeCount; i++) {
-    if ((memory_type_bits & (1 << i)) && (physical_device_memory_properties.memoryTypes[i].propertyFlags & memoryflags) == memoryflags) {
-      memory_type = i;
-      break;
-    }
-  }
-
-  VkMemoryAllocateInfo allocation_info = {
-    VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, // sType
-    nullptr, // pNext (see documentation, must be null)
-    memory_requirements.size, // the memory size
-    memory_type // the memory type index
-  };
-
-  debug::handleVkResult(
-    vkAllocateMemory(
-      this->vk_logical_device_, // the logical devcie
-      &allocation_info, // the allocation info
-      nullptr, // allocation callback
-      image_memory // allocated memory for memory object
-    )
-  );
+  // the image gets a range of one of the allocator's arenas, optimal tiled
+  // images are kept apart from linear resources
+  *image_memory = this->allocator_->Allocate(memory_requirements, memoryflags, tiling == VK_IMAGE_TILING_LINEAR);
 
   debug::handleVkResult(
     vkBindImageMemory(
       this->vk_logical_device_, // the logical device
       *image, // the image
-      *image_memory, // the image memory
-      0 // the offset in the memory
+      image_memory->memory, // the image memory
+      image_memory->offset // the offset in the memory
     )
   );
 }
@@ -2092,11 +2532,11 @@ void Context::CreateFrameBuffer() {
   );
 }
 
-void Context::CreateCommandPool(VkCommandPool* pool) {
+void Context::CreateCommandPool(VkCommandPoolCreateFlags flags, VkCommandPool* pool) {
   VkCommandPoolCreateInfo command_pool_info = {
     VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, // sType
     nullptr,// pNext (see documentation, must be null)
-    0, // flags (see documentation, must be 0)
+    flags, // flags (e.g. whether command buffers can be reset individually)
     this->queue_family_index_ // the queue family
   };
 
@@ -0,0 +1,237 @@
+#include "quavis/cpu/context.h"
+#include "quavis/vk/geometry/geojson.hpp"
+#include "quavis/trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+using namespace quavis;
+using namespace quavis::cpu;
+
+cpu::Context::Context(std::vector<std::string> metrics, size_t num_threads, uint32_t width, uint32_t height, std::string kernel)
+  : num_threads_(num_threads), width_(width), height_(height), kernel_name_(kernel) {
+  for (std::string name : metrics) {
+    if (name != "area" && name != "volume" && name != "minradial" && name != "maxradial" && name != "skyratio")
+      throw "Unknown metric.";
+    this->metrics_.push_back({name, metric_render_mode(name)});
+  }
+
+  if (this->num_threads_ == 0)
+    this->num_threads_ = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+  // the pixel centers of the spherical projection in shader.geom: columns
+  // span the azimuth phi in [-pi, pi], rows the polar angle theta in [0, pi]
+  // starting at the zenith
+  for (uint32_t y = 0; y < this->height_; y++) {
+    float theta = (y + 0.5f) * M_PI / this->height_;
+    for (uint32_t x = 0; x < this->width_; x++) {
+      float phi = ((x + 0.5f) * 2.0f / this->width_ - 1.0f) * M_PI;
+      this->directions_x_.push_back(sinf(theta) * cosf(phi));
+      this->directions_y_.push_back(sinf(theta) * sinf(phi));
+      this->directions_z_.push_back(cosf(theta));
+    }
+  }
+
+  this->kernel_ = select_packet_kernel(this->kernel_name_);
+}
+
+std::map<std::string, std::vector<float>> cpu::Context::Parse(const std::string& contents, vec3_span analysispoints, float alpha_max, float r_max, std::vector<std::string> metrics, std::function<bool()> cancelled) {
+  // the requested metrics and the render modes they need
+  std::vector<size_t> requested = {};
+  bool render_mode_used[RENDER_MODE_COUNT] = {false, false};
+  for (std::string name : metrics) {
+    size_t m = this->GetMetricIndex(name);
+    requested.push_back(m);
+    render_mode_used[this->metrics_[m].render_mode] = true;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  this->LoadScene(contents);
+  std::chrono::duration<double> load_time = std::chrono::steady_clock::now() - start;
+  this->stage_times_ = {{"load_scene", load_time.count()}, {"render", 0.0}, {"reduce", 0.0}};
+
+  std::map<std::string, std::vector<float>> results;
+  for (size_t m : requested)
+    results[this->metrics_[m].name] = std::vector<float>(analysispoints.size());
+
+  // observers are handed out one by one; the calling thread takes part and
+  // is the only one polling cancelled
+  std::atomic<size_t> next(0);
+  std::atomic<bool> stopped(false);
+  std::mutex stage_times_mutex;
+  // the threads add their spans to the caller's trace
+  Trace *calling_trace = trace::current();
+  auto work = [&](bool poll) {
+    trace::Scope scope(calling_trace);
+    trace::Span span("observers", "cpu");
+    std::vector<float> distances(this->width_ * this->height_);
+    std::vector<vec2> image(this->width_ * this->height_);
+    std::chrono::duration<double> render_time(0), reduce_time(0);
+    for (size_t i = next++; i < analysispoints.size() && !stopped; i = next++) {
+      if (poll && cancelled && cancelled()) {
+        stopped = true;
+        break;
+      }
+
+      for (size_t mode = 0; mode < RENDER_MODE_COUNT; mode++) {
+        if (!render_mode_used[mode])
+          continue;
+
+        auto render_start = std::chrono::steady_clock::now();
+        this->Render(analysispoints[i], r_max, alpha_max, (RenderMode)mode, distances, image);
+        auto reduce_start = std::chrono::steady_clock::now();
+        for (size_t m : requested)
+          if (this->metrics_[m].render_mode == mode)
+            results[this->metrics_[m].name][i] = this->Reduce(this->metrics_[m].name, image);
+        render_time += reduce_start - render_start;
+        reduce_time += std::chrono::steady_clock::now() - reduce_start;
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(stage_times_mutex);
+    this->stage_times_["render"] += render_time.count();
+    this->stage_times_["reduce"] += reduce_time.count();
+  };
+
+  std::vector<std::thread> threads = {};
+  for (size_t t = 1; t < std::min(this->num_threads_, analysispoints.size()); t++)
+    threads.push_back(std::thread(work, false));
+  work(true);
+  for (std::thread& thread : threads)
+    thread.join();
+
+  if (stopped)
+    throw Cancelled();
+  return results;
+}
+
+std::vector<uint64_t> cpu::Context::GetPrimitiveCounts() {
+  return {};
+}
+
+std::map<std::string, uint64_t> cpu::Context::GetPipelineStatistics() {
+  return {};
+}
+
+std::map<std::string, double> cpu::Context::GetStageTimes() {
+  return this->stage_times_;
+}
+
+uint64_t cpu::Context::GetDeviceMemory() {
+  return 0;
+}
+
+size_t cpu::Context::GetMetricIndex(std::string name) {
+  for (size_t m = 0; m < this->metrics_.size(); m++)
+    if (this->metrics_[m].name == name)
+      return m;
+  throw "Metric not supported by this context.";
+}
+
+void cpu::Context::LoadScene(const std::string& contents) {
+  // unlike the device's tiling, the hierarchy does not depend on r_max
+  if (this->scene_loaded_ && this->scene_contents_ == contents)
+    return;
+
+  trace::Span span("load scene", "scene");
+  std::vector<vec3> vertices = geojson::parse(contents);
+  std::vector<Triangle> triangles(vertices.size() / 3);
+  for (size_t t = 0; t < triangles.size(); t++)
+    triangles[t] = {vertices[3*t], vertices[3*t+1], vertices[3*t+2]};
+  trace::Span bvh_span("build bvh", "scene");
+  this->bvh_ = build_bvh(triangles);
+  this->triangles_ = to_soa(this->bvh_.triangles);
+
+  this->scene_contents_ = contents;
+  this->scene_loaded_ = true;
+}
+
+void cpu::Context::Render(vec3 observer, float r_max, float alpha_max, RenderMode mode, std::vector<float>& distances, std::vector<vec2>& image) {
+  const TriangleSoA& t = this->triangles_;
+  PacketScene scene = {
+    this->bvh_.nodes.data(), // nodes
+    this->bvh_.nodes.size(), // num_nodes
+    t.ax.data(), t.ay.data(), t.az.data(), // ax, ay, az
+    t.e1x.data(), t.e1y.data(), t.e1z.data(), // e1x, e1y, e1z
+    t.e2x.data(), t.e2y.data(), t.e2z.data() // e2x, e2y, e2z
+  };
+  PacketRays rays = {
+    observer.x, observer.y, observer.z, // ox, oy, oz
+    this->directions_x_.data(), // dx
+    this->directions_y_.data(), // dy
+    this->directions_z_.data(), // dz
+    distances.size() // count
+  };
+
+  // the device clips everything beyond r_max (depth > 1) and does not
+  // tessellate finer than a pixel (see shader.tesc)
+  float alpha = std::max(alpha_max, std::min(2 * (float) M_PI / this->width_, (float) M_PI / this->height_));
+  this->kernel_(scene, rays, r_max, mode == RENDER_MODE_NEAREST, alpha, distances.data());
+  for (size_t p = 0; p < distances.size(); p++)
+    image[p] = distances[p] == FLT_MAX ? vec2 {0, 0} : vec2 {distances[p] / r_max, 1};
+}
+
+float cpu::Context::Reduce(const std::string& metric, const std::vector<vec2>& image) {
+  const uint32_t W = this->width_, H = this->height_;
+  const float PI = M_PI;
+
+  if (metric == "area") {
+    // see shader.area.comp
+    float sum = 0;
+    for (uint32_t x = 0; x < W; x++) {
+      float tmp = 1.0f;
+      for (uint32_t y = 0; y < H/2; y++)
+        if (image[y*W + x].x > 0)
+          tmp = std::min(tmp, image[y*W + x].x);
+      sum += tmp*tmp;
+    }
+    return sum*PI/W;
+  }
+
+  if (metric == "volume") {
+    // see shader.volume.comp
+    float sum = 0;
+    for (uint32_t y = 0; y < H; y++) {
+      float s = sinf((y+0.5f)*PI/H);
+      for (uint32_t x = 0; x < W; x++) {
+        float r = image[y*W + x].x;
+        if (r == 0.0f) r = 1.0f;
+        sum += r*r*r*s;
+      }
+    }
+    return sum*PI*PI/(3.0f*H*H);
+  }
+
+  if (metric == "minradial") {
+    // see shader.minradial.comp
+    float tmp = 2.0f;
+    for (uint32_t y = 0; y < H/2; y++)
+      for (uint32_t x = 0; x < W; x++)
+        if (image[y*W + x].x > 0)
+          tmp = std::min(tmp, image[y*W + x].x);
+    return tmp > 1.0f ? 0.0f : tmp;
+  }
+
+  if (metric == "maxradial") {
+    // see shader.maxradial.comp
+    float result = 0;
+    for (uint32_t x = 0; x < W; x++) {
+      float tmp = 1.0f;
+      for (uint32_t y = 0; y < H; y++)
+        if (image[y*W + x].x > 0)
+          tmp = std::min(tmp, image[y*W + x].x);
+      result = std::max(result, tmp);
+    }
+    return result;
+  }
+
+  // skyratio, see shader.skyratio.comp
+  float sum = 0;
+  for (uint32_t y = 0; 2*y < H; y++)
+    for (uint32_t x = 0; x < W; x++)
+      if (image[y*W + x].y == 0.0f)
+        sum += sinf((y+0.5f)*PI/H)*PI/2/H/H;
+  return sum;
+}
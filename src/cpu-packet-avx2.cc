@@ -0,0 +1,38 @@
+#include "quavis/cpu/packet.h"
+
+#include <immintrin.h>
+#include <math.h>
+
+// packets of 8 rays, compiled with -mavx2
+
+namespace {
+  const size_t N = 8;
+  typedef __m256 V;
+  typedef __m256 M;
+
+  inline V set1(float a) { return _mm256_set1_ps(a); }
+  inline V load(const float *p) { return _mm256_loadu_ps(p); }
+  inline void store(float *p, V a) { _mm256_storeu_ps(p, a); }
+  inline V add(V a, V b) { return _mm256_add_ps(a, b); }
+  inline V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+  inline V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+  inline V div(V a, V b) { return _mm256_div_ps(a, b); }
+  inline V vsqrt(V a) { return _mm256_sqrt_ps(a); }
+  inline V vfloor(V a) { return _mm256_floor_ps(a); }
+  inline V vmin(V a, V b) { return _mm256_min_ps(a, b); }
+  inline V vmax(V a, V b) { return _mm256_max_ps(a, b); }
+  inline M lt(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+  inline M le(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+  inline M gt(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+  inline M ge(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+  inline M mand(M a, M b) { return _mm256_and_ps(a, b); }
+  inline M mor(M a, M b) { return _mm256_or_ps(a, b); }
+  inline bool any(M a) { return _mm256_movemask_ps(a) != 0; }
+  inline V select(M m, V a, V b) { return _mm256_blendv_ps(b, a, m); }
+}
+
+#include "cpu-packet.inl"
+
+void quavis::cpu::cast_packets_avx2(const PacketScene& scene, const PacketRays& rays, float max_distance, bool nearest, float alpha, float *distances) {
+  cast(scene, rays, max_distance, nearest, alpha, distances);
+}
@@ -0,0 +1,38 @@
+#include "quavis/cpu/packet.h"
+
+#include <immintrin.h>
+#include <math.h>
+
+// packets of 16 rays, compiled with -mavx512f
+
+namespace {
+  const size_t N = 16;
+  typedef __m512 V;
+  typedef __mmask16 M;
+
+  inline V set1(float a) { return _mm512_set1_ps(a); }
+  inline V load(const float *p) { return _mm512_loadu_ps(p); }
+  inline void store(float *p, V a) { _mm512_storeu_ps(p, a); }
+  inline V add(V a, V b) { return _mm512_add_ps(a, b); }
+  inline V sub(V a, V b) { return _mm512_sub_ps(a, b); }
+  inline V mul(V a, V b) { return _mm512_mul_ps(a, b); }
+  inline V div(V a, V b) { return _mm512_div_ps(a, b); }
+  inline V vsqrt(V a) { return _mm512_sqrt_ps(a); }
+  inline V vfloor(V a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+  inline V vmin(V a, V b) { return _mm512_min_ps(a, b); }
+  inline V vmax(V a, V b) { return _mm512_max_ps(a, b); }
+  inline M lt(V a, V b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+  inline M le(V a, V b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+  inline M gt(V a, V b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+  inline M ge(V a, V b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+  inline M mand(M a, M b) { return a & b; }
+  inline M mor(M a, M b) { return a | b; }
+  inline bool any(M a) { return a != 0; }
+  inline V select(M m, V a, V b) { return _mm512_mask_blend_ps(m, b, a); }
+}
+
+#include "cpu-packet.inl"
+
+void quavis::cpu::cast_packets_avx512(const PacketScene& scene, const PacketRays& rays, float max_distance, bool nearest, float alpha, float *distances) {
+  cast(scene, rays, max_distance, nearest, alpha, distances);
+}
@@ -0,0 +1,53 @@
+#include "quavis/cpu/packet.h"
+
+#include <math.h>
+
+// one ray at a time, for processors without the vector extensions
+
+namespace {
+  const size_t N = 1;
+  typedef float V;
+  typedef bool M;
+
+  inline V set1(float a) { return a; }
+  inline V load(const float *p) { return *p; }
+  inline void store(float *p, V a) { *p = a; }
+  inline V add(V a, V b) { return a + b; }
+  inline V sub(V a, V b) { return a - b; }
+  inline V mul(V a, V b) { return a * b; }
+  inline V div(V a, V b) { return a / b; }
+  inline V vsqrt(V a) { return sqrtf(a); }
+  inline V vfloor(V a) { return floorf(a); }
+  inline V vmin(V a, V b) { return a < b ? a : b; }
+  inline V vmax(V a, V b) { return a > b ? a : b; }
+  inline M lt(V a, V b) { return a < b; }
+  inline M le(V a, V b) { return a <= b; }
+  inline M gt(V a, V b) { return a > b; }
+  inline M ge(V a, V b) { return a >= b; }
+  inline M mand(M a, M b) { return a && b; }
+  inline M mor(M a, M b) { return a || b; }
+  inline bool any(M a) { return a; }
+  inline V select(M m, V a, V b) { return m ? a : b; }
+}
+
+#include "cpu-packet.inl"
+
+void quavis::cpu::cast_packets_scalar(const PacketScene& scene, const PacketRays& rays, float max_distance, bool nearest, float alpha, float *distances) {
+  cast(scene, rays, max_distance, nearest, alpha, distances);
+}
+
+quavis::cpu::PacketKernel quavis::cpu::select_packet_kernel(std::string& name) {
+#ifdef QUAVIS_CPU_SIMD
+  __builtin_cpu_init();
+  if ((name == "" || name == "avx512") && __builtin_cpu_supports("avx512f")) {
+    name = "avx512";
+    return cast_packets_avx512;
+  }
+  if ((name == "" || name == "avx512" || name == "avx2") && __builtin_cpu_supports("avx2")) {
+    name = "avx2";
+    return cast_packets_avx2;
+  }
+#endif
+  name = "scalar";
+  return cast_packets_scalar;
+}
@@ -0,0 +1,306 @@
+// Packet traversal shared by the kernels of all instruction sets. The
+// including file defines, in an anonymous namespace, the packet width N, the
+// vector type V, the mask type M and the operations on them used below.
+// Nothing here may call the inline functions of bvh.hpp, their copies would
+// be compiled with the instruction set of the including file.
+
+namespace {
+  // closest point of the triangle (a, a+e1, a+e2) to the origin, see
+  // closest_point_to_origin; returns its squared distance
+  inline float closest_distance2(float ax, float ay, float az, float e1x, float e1y, float e1z, float e2x, float e2y, float e2z) {
+    float bx = ax + e1x, by = ay + e1y, bz = az + e1z;
+    float cx = ax + e2x, cy = ay + e2y, cz = az + e2z;
+    float px, py, pz;
+
+    float d1 = -(e1x*ax + e1y*ay + e1z*az), d2 = -(e2x*ax + e2y*ay + e2z*az);
+    float d3 = -(e1x*bx + e1y*by + e1z*bz), d4 = -(e2x*bx + e2y*by + e2z*bz);
+    float d5 = -(e1x*cx + e1y*cy + e1z*cz), d6 = -(e2x*cx + e2y*cy + e2z*cz);
+    float vc = d1*d4 - d3*d2, vb = d5*d2 - d1*d6, va = d3*d6 - d5*d4;
+    if (d1 <= 0 && d2 <= 0) {
+      px = ax; py = ay; pz = az;
+    } else if (d3 >= 0 && d4 <= d3) {
+      px = bx; py = by; pz = bz;
+    } else if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+      float v = d1 / (d1 - d3);
+      px = ax + v*e1x; py = ay + v*e1y; pz = az + v*e1z;
+    } else if (d6 >= 0 && d5 <= d6) {
+      px = cx; py = cy; pz = cz;
+    } else if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+      float w = d2 / (d2 - d6);
+      px = ax + w*e2x; py = ay + w*e2y; pz = az + w*e2z;
+    } else if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) {
+      float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+      px = bx + w*(cx - bx); py = by + w*(cy - by); pz = bz + w*(cz - bz);
+    } else {
+      float denom = 1.0f / (va + vb + vc);
+      float v = vb * denom, w = vc * denom;
+      px = ax + v*e1x + w*e2x; py = ay + v*e1y + w*e2y; pz = az + v*e1z + w*e2z;
+    }
+    return px*px + py*py + pz*pz;
+  }
+
+  inline float angle(float ax, float ay, float az, float bx, float by, float bz) {
+    float nx = ay*bz - az*by, ny = az*bx - ax*bz, nz = ax*by - ay*bx;
+    return atan2f(sqrtf(nx*nx + ny*ny + nz*nz), ax*bx + ay*by + az*bz);
+  }
+
+  // see tessellation_level
+  inline float tessellation_level(float ax, float ay, float az, float bx, float by, float bz, float cx, float cy, float cz, float alpha) {
+    float ab = angle(ax, ay, az, bx, by, bz), ac = angle(ax, ay, az, cx, cy, cz), bc = angle(bx, by, bz, cx, cy, cz);
+    float level = ceilf((ab > ac ? (ab > bc ? ab : bc) : (ac > bc ? ac : bc)) / alpha);
+    return level < 1 ? 1 : (level > quavis::cpu::MAX_TESSELLATION_LEVEL ? quavis::cpu::MAX_TESSELLATION_LEVEL : level);
+  }
+
+  // points, one per lane
+  struct V3 {
+    V x;
+    V y;
+    V z;
+  };
+
+  inline V3 broadcast(float x, float y, float z) { return {set1(x), set1(y), set1(z)}; }
+  inline V vdot(V3 a, V3 b) { return add(add(mul(a.x, b.x), mul(a.y, b.y)), mul(a.z, b.z)); }
+  inline V3 vcross(V3 a, V3 b) {
+    return {sub(mul(a.y, b.z), mul(a.z, b.y)), sub(mul(a.z, b.x), mul(a.x, b.z)), sub(mul(a.x, b.y), mul(a.y, b.x))};
+  }
+  inline V3 vsub(V3 a, V3 b) { return {sub(a.x, b.x), sub(a.y, b.y), sub(a.z, b.z)}; }
+  inline V3 vscale(V3 a, V k) { return {mul(a.x, k), mul(a.y, k), mul(a.z, k)}; }
+  inline V3 vadd(V3 a, V3 b) { return {add(a.x, b.x), add(a.y, b.y), add(a.z, b.z)}; }
+  inline V3 vmix(V3 a, V3 b, V k) { return vadd(vscale(a, sub(set1(1.0f), k)), vscale(b, k)); }
+  inline V3 vselect(M m, V3 a, V3 b) { return {select(m, a.x, b.x), select(m, a.y, b.y), select(m, a.z, b.z)}; }
+  inline V vabs(V a) { return vmax(a, sub(set1(0.0f), a)); }
+
+  // atan2 for y >= 0, after Cephes' atanf: reduced to [0, 1] by symmetry and
+  // then to [-tan(pi/8), tan(pi/8)]
+  inline V vatan2(V y, V x) {
+    V ax = vabs(x);
+    V r = div(vmin(ax, y), vmax(vmax(ax, y), set1(FLT_MIN)));
+    M reduce = gt(r, set1(0.41421356f));
+    V z = select(reduce, div(sub(r, set1(1.0f)), add(r, set1(1.0f))), r);
+    V z2 = mul(z, z);
+    V p = add(mul(set1(8.05374449538e-2f), z2), set1(-1.38776856032e-1f));
+    p = add(mul(p, z2), set1(1.99777106478e-1f));
+    p = add(mul(p, z2), set1(-3.33329491539e-1f));
+    V a = add(mul(mul(p, z2), z), z);
+    a = select(reduce, add(a, set1((float)M_PI_4)), a);
+    a = select(gt(y, ax), sub(set1((float)M_PI_2), a), a);
+    return select(lt(x, set1(0.0f)), sub(set1((float)M_PI), a), a);
+  }
+
+  inline V vangle(V3 a, V3 b) {
+    V3 n = vcross(a, b);
+    return vatan2(vsqrt(vdot(n, n)), vdot(a, b));
+  }
+
+  // sine and cosine of angles in [0, pi], reduced to [0, pi/2] by symmetry
+  inline void vsincos(V angle, V& s, V& c) {
+    M mirror = gt(angle, set1((float)M_PI_2));
+    V x = select(mirror, sub(set1((float)M_PI), angle), angle);
+    V x2 = mul(x, x);
+    s = add(mul(set1(-1.0f / 39916800), x2), set1(1.0f / 362880));
+    s = add(mul(s, x2), set1(-1.0f / 5040));
+    s = add(mul(s, x2), set1(1.0f / 120));
+    s = add(mul(s, x2), set1(-1.0f / 6));
+    s = add(mul(mul(s, x2), x), x);
+    c = add(mul(set1(1.0f / 479001600), x2), set1(-1.0f / 3628800));
+    c = add(mul(c, x2), set1(1.0f / 40320));
+    c = add(mul(c, x2), set1(-1.0f / 720));
+    c = add(mul(c, x2), set1(1.0f / 24));
+    c = add(mul(c, x2), set1(-1.0f / 2));
+    c = add(mul(c, x2), set1(1.0f));
+    c = select(mirror, sub(set1(0.0f), c), c);
+  }
+
+  // see fraction_at_angle
+  inline V vfraction_at_angle(V3 p, V3 q, V alpha) {
+    V3 n = vcross(p, q);
+    V pp = vdot(p, p), s, c;
+    vsincos(alpha, s, c);
+    V k = div(mul(pp, s), add(mul(sub(pp, vdot(p, q)), s), mul(vsqrt(vdot(n, n)), c)));
+    return vmin(vmax(k, set1(0.0f)), set1(1.0f));
+  }
+
+  // see tessellate
+  inline V3 vtessellate(V3 a, V3 b, V3 c, V ab, V s, V t, V u) {
+    V zero = set1(0.0f);
+    V k = vfraction_at_angle(a, b, mul(div(t, add(s, t)), ab));
+    k = select(le(t, zero), zero, select(le(s, zero), set1(1.0f), k));
+    V3 p = vmix(a, b, k);
+    V l = vfraction_at_angle(p, c, mul(u, vangle(p, c)));
+    return vmix(p, c, l);
+  }
+
+  // see closest_distance2
+  inline V closest_distance2(V3 a, V3 b, V3 c) {
+    V zero = set1(0.0f);
+    V3 e1 = vsub(b, a), e2 = vsub(c, a);
+    V d1 = sub(zero, vdot(e1, a)), d2 = sub(zero, vdot(e2, a));
+    V d3 = sub(zero, vdot(e1, b)), d4 = sub(zero, vdot(e2, b));
+    V d5 = sub(zero, vdot(e1, c)), d6 = sub(zero, vdot(e2, c));
+    V vc = sub(mul(d1, d4), mul(d3, d2)), vb = sub(mul(d5, d2), mul(d1, d6)), va = sub(mul(d3, d6), mul(d5, d4));
+
+    // the regions are tested in reverse, such that the first one applies
+    V denom = div(set1(1.0f), add(add(va, vb), vc));
+    V3 p = vadd(a, vadd(vscale(e1, mul(vb, denom)), vscale(e2, mul(vc, denom))));
+    V w = div(sub(d4, d3), add(sub(d4, d3), sub(d5, d6)));
+    p = vselect(mand(le(va, zero), mand(ge(sub(d4, d3), zero), ge(sub(d5, d6), zero))), vmix(b, c, w), p);
+    p = vselect(mand(le(vb, zero), mand(ge(d2, zero), le(d6, zero))), vadd(a, vscale(e2, div(d2, sub(d2, d6)))), p);
+    p = vselect(mand(ge(d6, zero), le(d5, d6)), c, p);
+    p = vselect(mand(le(vc, zero), mand(ge(d1, zero), le(d3, zero))), vadd(a, vscale(e1, div(d1, sub(d1, d3)))), p);
+    p = vselect(mand(ge(d3, zero), le(d4, d3)), b, p);
+    p = vselect(mand(le(d1, zero), le(d2, zero)), a, p);
+    return vdot(p, p);
+  }
+
+  // The squared distance of the origin to the subtriangle of abc (relative to
+  // the origin) that the device renders where each ray hits it at the
+  // barycentric coordinates v and w, see rendered_subtriangle.
+  inline V rendered_distance2(V3 a, V3 b, V3 c, float level, V v, V w) {
+    V zero = set1(0.0f), one = set1(1.0f), L = set1(level), last = set1(level - 1);
+
+    // tessellation coordinates, see tessellation_coordinates
+    V ab = vangle(a, b);
+    V k = select(lt(w, one), div(v, sub(one, w)), zero);
+    V3 p = vmix(a, b, k);
+    V3 x = vmix(p, c, w);
+    V pc = vangle(p, c);
+    V tu = select(gt(pc, zero), vmin(div(vangle(p, x), pc), one), zero);
+    V tt = mul(sub(one, tu), select(gt(ab, zero), vmin(div(vangle(a, p), ab), one), zero));
+
+    // grid cell, see grid_cell
+    V i = vmin(vfloor(mul(tt, L)), last), j = vmin(vfloor(mul(tu, L)), last);
+    M upper = gt(add(sub(mul(tt, L), i), sub(mul(tu, L), j)), one);
+    V excess = vmax(sub(add(i, j), last), zero);
+    V di = vmin(i, excess);
+    i = sub(i, di);
+    j = sub(j, sub(excess, di));
+    upper = mand(upper, le(excess, zero));
+
+    // corners (i+1, j), (i, j+1) and (i+1, j+1) of the upper or (i, j) of
+    // the lower subtriangle, see grid_subtriangle
+    auto corner = [&](V ci, V cj) {
+      return vtessellate(a, b, c, ab, sub(one, div(add(ci, cj), L)), div(ci, L), div(cj, L));
+    };
+    V3 c1 = corner(add(i, one), j), c2 = corner(i, add(j, one));
+    V3 c3 = corner(select(upper, add(i, one), i), select(upper, add(j, one), j));
+    return closest_distance2(c1, c2, c3);
+  }
+
+  inline float box_distance2(const quavis::cpu::BvhNode& node, float ox, float oy, float oz) {
+    float dx = node.min.x - ox > 0 ? node.min.x - ox : (ox - node.max.x > 0 ? ox - node.max.x : 0);
+    float dy = node.min.y - oy > 0 ? node.min.y - oy : (oy - node.max.y > 0 ? oy - node.max.y : 0);
+    float dz = node.min.z - oz > 0 ? node.min.z - oz : (oz - node.max.z > 0 ? oz - node.max.z : 0);
+    return dx*dx + dy*dy + dz*dz;
+  }
+
+  void cast(const quavis::cpu::PacketScene& scene, const quavis::cpu::PacketRays& rays, float max_distance, bool nearest, float alpha, float *distances) {
+    for (size_t base = 0; base < rays.count; base += N) {
+      // the last packet is padded with copies of the last ray
+      float dx[N], dy[N], dz[N], out[N];
+      for (size_t l = 0; l < N; l++) {
+        size_t r = base + l < rays.count ? base + l : rays.count - 1;
+        dx[l] = rays.dx[r]; dy[l] = rays.dy[r]; dz[l] = rays.dz[r];
+      }
+
+      V Dx = load(dx), Dy = load(dy), Dz = load(dz);
+      V Ix = div(set1(1.0f), Dx), Iy = div(set1(1.0f), Dy), Iz = div(set1(1.0f), Dz);
+      V Ox = set1(rays.ox), Oy = set1(rays.oy), Oz = set1(rays.oz);
+      V zero = set1(0.0f), one = set1(1.0f), inf = set1(FLT_MAX);
+
+      // nearest hit distance along each ray, or the smallest squared distance
+      // of the subtriangles hit by each ray
+      V best = set1(nearest ? max_distance * max_distance : max_distance);
+      M hit = lt(one, zero);
+
+      uint32_t stack[64];
+      int size = 0;
+      if (scene.num_nodes > 0)
+        stack[size++] = 0;
+      while (size > 0) {
+        const quavis::cpu::BvhNode& node = scene.nodes[stack[--size]];
+
+        // no triangle of the box can be nearer than the box itself
+        M active = lt(zero, one);
+        if (nearest) {
+          active = le(set1(box_distance2(node, rays.ox, rays.oy, rays.oz)), best);
+          if (!any(active))
+            continue;
+        }
+
+        V t1x = mul(sub(set1(node.min.x), Ox), Ix), t2x = mul(sub(set1(node.max.x), Ox), Ix);
+        V t1y = mul(sub(set1(node.min.y), Oy), Iy), t2y = mul(sub(set1(node.max.y), Oy), Iy);
+        V t1z = mul(sub(set1(node.min.z), Oz), Iz), t2z = mul(sub(set1(node.max.z), Oz), Iz);
+        V tnear = vmax(vmax(vmin(t1x, t2x), vmin(t1y, t2y)), vmax(vmin(t1z, t2z), zero));
+        V tfar = vmin(vmin(vmax(t1x, t2x), vmax(t1y, t2y)), vmin(vmax(t1z, t2z), nearest ? inf : best));
+        active = mand(active, le(tnear, tfar));
+        if (!any(active))
+          continue;
+
+        if (node.count == 0) {
+          // visit the child nearer to the origin first
+          uint32_t near = node.first, far = node.first + 1;
+          if (box_distance2(scene.nodes[far], rays.ox, rays.oy, rays.oz) < box_distance2(scene.nodes[near], rays.ox, rays.oy, rays.oz)) {
+            near = node.first + 1;
+            far = node.first;
+          }
+          stack[size++] = far;
+          stack[size++] = near;
+          continue;
+        }
+
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+          // Moeller-Trumbore, the terms only depending on the origin are shared
+          float e1x = scene.e1x[i], e1y = scene.e1y[i], e1z = scene.e1z[i];
+          float e2x = scene.e2x[i], e2y = scene.e2y[i], e2z = scene.e2z[i];
+          float sx = rays.ox - scene.ax[i], sy = rays.oy - scene.ay[i], sz = rays.oz - scene.az[i];
+          float qx = sy*e1z - sz*e1y, qy = sz*e1x - sx*e1z, qz = sx*e1y - sy*e1x;
+          float e2q = e2x*qx + e2y*qy + e2z*qz;
+
+          V px = sub(mul(Dy, set1(e2z)), mul(Dz, set1(e2y)));
+          V py = sub(mul(Dz, set1(e2x)), mul(Dx, set1(e2z)));
+          V pz = sub(mul(Dx, set1(e2y)), mul(Dy, set1(e2x)));
+          V det = add(add(mul(set1(e1x), px), mul(set1(e1y), py)), mul(set1(e1z), pz));
+          V inv_det = div(one, det);
+          V u = mul(add(add(mul(set1(sx), px), mul(set1(sy), py)), mul(set1(sz), pz)), inv_det);
+          V v = mul(add(add(mul(Dx, set1(qx)), mul(Dy, set1(qy))), mul(Dz, set1(qz))), inv_det);
+          V t = mul(set1(e2q), inv_det);
+
+          M valid = gt(vmax(det, sub(zero, det)), set1(1e-12f));
+          valid = mand(valid, mand(ge(u, zero), le(u, one)));
+          valid = mand(valid, mand(ge(v, zero), le(add(u, v), one)));
+          valid = mand(valid, gt(t, set1(EPS)));
+          if (!any(valid))
+            continue;
+
+          if (nearest) {
+            // the whole triangle is never nearer than its subtriangles
+            float d2 = closest_distance2(-sx, -sy, -sz, e1x, e1y, e1z, e2x, e2y, e2z);
+            M closer = mand(valid, le(set1(d2), best));
+            if (!any(closer))
+              continue;
+
+            // the subtriangles are resolved in all lanes at once
+            V part_d2 = set1(d2);
+            float level = tessellation_level(-sx, -sy, -sz, e1x - sx, e1y - sy, e1z - sz, e2x - sx, e2y - sy, e2z - sz, alpha);
+            if (level > 1) {
+              V3 a = broadcast(-sx, -sy, -sz);
+              V3 b = broadcast(e1x - sx, e1y - sy, e1z - sz), c = broadcast(e2x - sx, e2y - sy, e2z - sz);
+              part_d2 = rendered_distance2(a, b, c, level, u, v);
+            }
+            closer = mand(closer, le(part_d2, best));
+            best = select(closer, part_d2, best);
+            hit = mor(hit, closer);
+          } else {
+            M closer = mand(valid, le(t, best));
+            best = select(closer, t, best);
+            hit = mor(hit, closer);
+          }
+        }
+      }
+
+      store(out, select(hit, best, inf));
+      for (size_t l = 0; l < N && base + l < rays.count; l++)
+        distances[base + l] = (nearest && out[l] != FLT_MAX) ? sqrtf(out[l]) : out[l];
+    }
+  }
+}
@@ -0,0 +1,277 @@
+#include "quavis/service.h"
+
+#include <stdio.h>
+#include <argp.h>
+#include <signal.h>
+#include <unistd.h>
+
+/**
+* The metrics computed by quavis-isovist and the units of their results.
+*/
+const std::vector<std::pair<std::string, std::string>> metric_units = {
+  {"area",      "m3"},
+  {"minradial", "m"},
+  {"maxradial", "m"},
+  {"volume",    "m3"},
+  {"skyratio",  "m3"}
+};
+
+json register_message(std::string metric) {
+  return {
+    {"serviceName",        "quavis-isovist-" + metric},
+    {"description",        "Returns the Isovist of a given scenario"},
+    {"qua-view-compliant", true},
+    {"inputs",             {
+                             {"ScID",  "number"},
+                             {"mode",      "string"},
+                             {"points", "attachment"},
+                             {"alpha_max",  "number"},
+                             {"r_max", "number"},
+                             {"OPT deadline", "number"}, // seconds, the resolution is lowered if necessary to meet it
+                             {"OPT trace", "boolean"} // writes a Chrome trace of the run, its path is sent with the result
+                           }},
+    {"outputs",            {
+                             {"units", "string"},
+                             {"values",    "string"}
+                           }},
+    {"constraints",        {
+                             {"mode",  {"points", "objects", "scenario", "new"}},
+                             {"alpha_max", {
+                                             {"integer", false},
+                                             {"min", 0.01},
+                                             {"max", 1.5},
+                                             {"def", 0.1}
+                                           }},
+                             {"r_max",  {
+                                          {"integer", false},
+                                          {"min", 1},
+                                          {"max", 100000},
+                                          {"def", 5000}
+                                        }}
+                           }},
+    {"exampleCall",        {
+                             {"run",   "GenericIsovistService"},
+                             {"callId",    4386},
+                             {"mode",   "points"},
+                             {"attachment", {
+                                              {"length", 512},
+                                              {"position", 1},
+                                              {"checksum", "abc"}
+                                            }}
+                           }}
+  };
+}
+
+void run_service(quavis::IsovistService *service, int retries) {
+  time_t timestamp = std::time(NULL);
+  try {
+    std::cout << "INFO: " << "Starting Service " << service->GetName() << std::endl;
+    service->Run();
+  }
+  catch (const char *what) {
+    std::cout << "WARNING: " << "An error occurred: " << what << std::endl;
+    std::cout << "INFO: " << "Trying to reestablish the connection in 1 seconds." << std::endl;
+    usleep(1000000);
+    if (std::time(NULL) - timestamp < retries) {
+      run_service(service, --retries);
+    } else {
+      std::cout << "ERROR: " << "Number of retries exceeded." << std::endl;
+      exit(-1);
+    }
+  }
+}
+
+/* Argument parsing options */
+struct arguments {
+  char const *host;
+  int port;
+  int loglevel;
+  int retries;
+  int workers;
+  int coalesce;
+  int chunk;
+  long max_points;
+  long max_scene;
+  double max_gpu_time;
+  char const *backend;
+  bool statistics;
+  bool trace;
+  char const *trace_dir;
+  char const *metrics_file;
+  int metrics_port;
+  int metrics_interval;
+  char const *pipeline_cache;
+};
+static char doc[] = "Runs the isovist services of all metrics until terminated. The services share the workers, their devices and the uploaded scenarios.";
+static char args_doc[] = "";
+static struct argp_option options[] = {
+  {"host",     'h', "localhost", 0, "The host address of Luci"},
+  {"port",     'p', "7654",      0, "The port of Luci"},
+  {"loglevel", 'l', "2",         0, "The loglevel\n0: all, 1: debug, 2: info, 3: warning, 4: error"},
+  {"retries",  'r', "5",         0, "The number of retries when the connection could not be established or has ended unexpectedly. The service performs one retry per second."},
+  {"workers",  'w', "2",         0, "The number of worker threads computing isovists. Every worker uses its own device context for all metrics."},
+  {"coalesce", 'c', "20",        0, "The time in milliseconds that runs on the same scenario may join a batch after the scenario has been fetched. Runs in a batch are rendered together."},
+  {"chunk",    'k', "4096",      0, "The number of points computed between two progress messages. Each progress message contains the values of the points computed since the last one."},
+  {"max-points",   'P', "4000000", 0, "The maximum number of points of all queued runs. Larger runs are rejected, runs exceeding the limit together with the queue are deferred. 0 disables the limit."},
+  {"max-scene",    'S', "256",     0, "The maximum size of a scenario in MB. Runs on larger scenarios are rejected. 0 disables the limit."},
+  {"max-gpu-time", 'T', "0",       0, "The maximum estimated computation time of all queued runs in seconds. 0 disables the limit."},
+  {"backend",      'b', "gpu",     0, "Where the isovists are computed\ngpu: on the graphics card, cpu: with ray casting on all cores (for nodes without graphics card)"},
+  {"statistics",   'q', 0,         0, "Collect the pipeline statistics of the graphics card (e.g. the primitives emitted by the tessellator), log them and send them with the results"},
+  {"trace",        'x', 0,         0, "Trace every run, not only those with the input trace set. The traces are Chrome trace files (chrome://tracing, Perfetto) of the stages of a run on the host and the device."},
+  {"trace-dir",    'X', ".",       0, "The directory the traces of runs are written to"},
+  {"metrics-file",     'F', "FILE", 0, "Writes the metrics of the services (runs, points, queue depth, latencies, device memory) in the Prometheus text format to the file, e.g. for the textfile collector of the node exporter"},
+  {"metrics-port",     'M', "0",    0, "Serves the metrics in the Prometheus text format on this port of localhost. 0 disables it."},
+  {"metrics-interval", 'I', "15",   0, "The time in seconds between two updates of the metrics file"},
+  {"pipeline-cache",   'C', "FILE", 0, "Reads the compiled pipelines from and writes them to the file, such that later starts on the same graphics card and driver are faster"},
+  {0}
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+  struct arguments *args = (arguments *) (state->input);
+  switch (key) {
+    case 'p':
+      args->port = arg ? atoi(arg) : 7654;
+      break;
+    case 'h':
+      args->host = arg;
+      break;
+    case 'l':
+      args->loglevel = arg ? atoi(arg) : 2;  // Not in use
+      break;
+    case 'r':
+      args->retries = arg ? atoi(arg) : 5;
+      break;
+    case 'w':
+      args->workers = arg ? atoi(arg) : 2;
+      break;
+    case 'c':
+      args->coalesce = arg ? atoi(arg) : 20;
+      break;
+    case 'k':
+      args->chunk = arg ? atoi(arg) : 4096;
+      break;
+    case 'P':
+      args->max_points = arg ? atol(arg) : 4000000;
+      break;
+    case 'S':
+      args->max_scene = arg ? atol(arg) : 256;
+      break;
+    case 'T':
+      args->max_gpu_time = arg ? atof(arg) : 0;
+      break;
+    case 'b':
+      args->backend = arg;
+      break;
+    case 'q':
+      args->statistics = true;
+      break;
+    case 'x':
+      args->trace = true;
+      break;
+    case 'X':
+      args->trace_dir = arg;
+      break;
+    case 'F':
+      args->metrics_file = arg;
+      break;
+    case 'M':
+      args->metrics_port = arg ? atoi(arg) : 0;
+      break;
+    case 'I':
+      args->metrics_interval = arg ? atoi(arg) : 15;
+      break;
+    case 'C':
+      args->pipeline_cache = arg;
+      break;
+    case ARGP_KEY_END:
+      if (state->arg_num < 0) argp_usage(state);
+      break;
+    case ARGP_KEY_ARG:
+      if (state->arg_num > 0) argp_usage(state);
+      break;
+    default:
+      return ARGP_ERR_UNKNOWN;
+  }
+  return 0;
+}
+
+/* Run services using arguments */
+int main(int argc, char **argv) {
+  struct arguments args;
+
+  /* Default values. */
+  args.host = "localhost";
+  args.port = 7654;
+  args.loglevel = 2;
+  args.retries = 5;
+  args.workers = 2;
+  args.coalesce = 20;
+  args.chunk = 4096;
+  args.max_points = 4000000;
+  args.max_scene = 256;
+  args.max_gpu_time = 0;
+  args.backend = "gpu";
+  args.statistics = false;
+  args.trace = false;
+  args.trace_dir = ".";
+  args.metrics_file = "";
+  args.metrics_port = 0;
+  args.metrics_interval = 15;
+  args.pipeline_cache = "";
+
+  /* Parse our arguments; every option seen by parse_opt will be
+     reflected in arguments. */
+  static struct argp argp = {options, parse_opt, args_doc, doc};
+  argp_parse(&argp, argc, argv, 0, 0, &args);
+
+  /* Create one engine for all metrics and a service per metric */
+  sigset_t signals = quavis::block_stop_signals();
+  std::vector<std::string> metrics = {};
+  for (auto& metric : metric_units)
+    metrics.push_back(metric.first);
+  quavis::IsovistLimits limits = {(size_t) args.max_points, (size_t) args.max_scene * 1024 * 1024, args.max_gpu_time};
+  quavis::IsovistTracing tracing = {args.trace, args.trace_dir};
+  bool statistics = args.statistics;
+  std::string pipeline_cache = args.pipeline_cache;
+  quavis::IsovistEngine::BackendFactory create_backend = [statistics, pipeline_cache](std::vector<std::string> metrics) -> quavis::Backend * {
+    return new quavis::Context(metrics, statistics, pipeline_cache);
+  };
+  if (std::string(args.backend) == "cpu") {
+    // the workers share the cores
+    size_t threads = std::max<size_t>(1, std::thread::hardware_concurrency() / std::max(args.workers, 1));
+    create_backend = [threads](std::vector<std::string> metrics) -> quavis::Backend * {
+      return new quavis::cpu::Context(metrics, threads);
+    };
+  }
+  quavis::IsovistEngine *engine = new quavis::IsovistEngine(metrics, args.workers, std::chrono::milliseconds(args.coalesce), args.chunk, limits, tracing, create_backend);
+
+  /* Publish the metrics of all services */
+  std::unique_ptr<quavis::MetricsExporter> exporter;
+  try {
+    exporter.reset(new quavis::MetricsExporter(&engine->GetRegistry(), args.metrics_file, args.metrics_port, std::chrono::seconds(std::max(args.metrics_interval, 1))));
+  }
+  catch (const char *what) {
+    std::cout << "ERROR: " << what << std::endl;
+    exit(-1);
+  }
+
+  std::vector<quavis::IsovistService *> services = {};
+  for (auto& metric : metric_units) {
+    std::shared_ptr<luciconnect::Connection> connection = std::make_shared<luciconnect::Connection>(args.host, args.port);
+    services.push_back(new quavis::IsovistService(connection, register_message(metric.first), metric.first, metric.second, engine));
+  }
+  quavis::stop_on_signal(signals, services);
+
+  /* Start the services */
+  std::vector<std::thread> threads = {};
+  for (quavis::IsovistService *service : services)
+    threads.push_back(std::thread(run_service, service, args.retries));
+  for (std::thread& thread : threads)
+    thread.join();
+
+  /* Finish the queued jobs and clean up */
+  exporter.reset();
+  delete engine;
+  for (quavis::IsovistService *service : services)
+    delete service;
+}
@@ -0,0 +1,180 @@
+#include "quavis/cpu/context.h"
+
+#include <iostream>
+#include <chrono>
+#include <random>
+
+// Compares the CPU metrics with analytic values and the packet kernels with
+// the single ray traversal:
+//   g++ -std=c++14 -O2 -DQUAVIS_CPU_SIMD -Iinclude -mavx2 -c src/cpu-packet-avx2.cc
+//   g++ -std=c++14 -O2 -DQUAVIS_CPU_SIMD -Iinclude -mavx512f -c src/cpu-packet-avx512.cc
+//   g++ -std=c++14 -O2 -DQUAVIS_CPU_SIMD -Iinclude -pthread test/cpu.cc src/cpu-context.cc
+//     src/cpu-packet-scalar.cc cpu-packet-avx2.o cpu-packet-avx512.o
+
+std::string face(std::vector<quavis::vec3> ring) {
+  std::string coordinates = "";
+  for (quavis::vec3 p : ring)
+    coordinates += "[" + std::to_string(p.x) + "," + std::to_string(p.y) + "," + std::to_string(p.z) + "],";
+  coordinates += "[" + std::to_string(ring[0].x) + "," + std::to_string(ring[0].y) + "," + std::to_string(ring[0].z) + "]";
+  return "{\"type\":\"Feature\",\"geometry\":{\"type\":\"Polygon\",\"coordinates\":[[" + coordinates + "]]}}";
+}
+
+// closed cube with edge length 2 around the origin
+std::string cube() {
+  float s = 1;
+  std::vector<std::vector<quavis::vec3>> faces = {
+    {{-s,-s,-s}, { s,-s,-s}, { s, s,-s}, {-s, s,-s}},
+    {{-s,-s, s}, { s,-s, s}, { s, s, s}, {-s, s, s}},
+    {{-s,-s,-s}, { s,-s,-s}, { s,-s, s}, {-s,-s, s}},
+    {{-s, s,-s}, { s, s,-s}, { s, s, s}, {-s, s, s}},
+    {{-s,-s,-s}, {-s, s,-s}, {-s, s, s}, {-s,-s, s}},
+    {{ s,-s,-s}, { s, s,-s}, { s, s, s}, { s,-s, s}}
+  };
+  std::string features = "";
+  for (size_t f = 0; f < faces.size(); f++)
+    features += (f > 0 ? "," : "") + face(faces[f]);
+  return "{\"type\":\"FeatureCollection\",\"features\":[" + features + "]}";
+}
+
+int failures = 0;
+
+void check(std::string name, float value, float expected, float tolerance) {
+  bool ok = fabs(value - expected) <= tolerance;
+  failures += !ok;
+  std::cout << (ok ? "OK   " : "FAIL ") << name << ": " << value << " (expected " << expected << ")" << std::endl;
+}
+
+// random triangles around the origin, traced by the kernel and ray by ray
+void check_kernel(std::string kernel) {
+  std::mt19937 random(1);
+  std::uniform_real_distribution<float> coordinate(-5, 5);
+  std::vector<quavis::cpu::Triangle> triangles(2000);
+  for (quavis::cpu::Triangle& t : triangles) {
+    quavis::vec3 center = {coordinate(random), coordinate(random), coordinate(random)};
+    t.a = center + quavis::vec3 {coordinate(random), coordinate(random), coordinate(random)} * 0.1f;
+    t.b = center + quavis::vec3 {coordinate(random), coordinate(random), coordinate(random)} * 0.1f;
+    t.c = center + quavis::vec3 {coordinate(random), coordinate(random), coordinate(random)} * 0.1f;
+  }
+  quavis::cpu::Bvh bvh = quavis::cpu::build_bvh(triangles);
+  quavis::cpu::TriangleSoA soa = quavis::cpu::to_soa(bvh.triangles);
+  quavis::cpu::PacketScene scene = {bvh.nodes.data(), bvh.nodes.size(),
+    soa.ax.data(), soa.ay.data(), soa.az.data(),
+    soa.e1x.data(), soa.e1y.data(), soa.e1z.data(),
+    soa.e2x.data(), soa.e2y.data(), soa.e2z.data()};
+
+  std::vector<float> dx, dy, dz;
+  for (int i = 0; i < 1003; i++) {
+    quavis::vec3 d = {coordinate(random), coordinate(random), coordinate(random)};
+    d = d * (1.0f / sqrtf(d * d));
+    dx.push_back(d.x); dy.push_back(d.y); dz.push_back(d.z);
+  }
+
+  std::string name = kernel;
+  quavis::cpu::PacketKernel cast = quavis::cpu::select_packet_kernel(name);
+  if (name != kernel) {
+    std::cout << "SKIP " << kernel << " kernel: not supported" << std::endl;
+    return;
+  }
+
+  for (int nearest = 0; nearest < 2; nearest++) {
+    size_t mismatches = 0;
+    for (int o = 0; o < 4; o++) {
+      quavis::vec3 origin = {coordinate(random), coordinate(random), coordinate(random)};
+      quavis::cpu::PacketRays rays = {origin.x, origin.y, origin.z, dx.data(), dy.data(), dz.data(), dx.size()};
+      std::vector<float> distances(dx.size());
+      cast(scene, rays, 8, nearest, 0.02, distances.data());
+      for (size_t r = 0; r < dx.size(); r++) {
+        quavis::vec3 direction = {dx[r], dy[r], dz[r]};
+        float expected = nearest
+          ? quavis::cpu::intersect_nearest(bvh, origin, direction, 8, 0.02)
+          : quavis::cpu::intersect(bvh, origin, direction, 8);
+        if (expected == FLT_MAX ? distances[r] != FLT_MAX : fabs(distances[r] - expected) > 1e-3)
+          mismatches++;
+      }
+    }
+    failures += mismatches > 0;
+    std::cout << (mismatches == 0 ? "OK   " : "FAIL ") << kernel << " kernel " << (nearest ? "nearest" : "center")
+      << ": " << mismatches << " mismatches" << std::endl;
+  }
+}
+
+// the nearest point of all subtriangles of the tessellation that the ray hits
+float tessellated_nearest(std::vector<quavis::cpu::Triangle> triangles, quavis::vec3 origin, quavis::vec3 direction, float alpha) {
+  float nearest = FLT_MAX;
+  for (quavis::cpu::Triangle t : triangles) {
+    quavis::vec3 a = t.a - origin, b = t.b - origin, c = t.c - origin;
+    float level = quavis::cpu::tessellation_level(a, b, c, alpha);
+    for (float i = 0; i < level; i++) {
+      for (float j = 0; i + j < level; j++) {
+        for (int upper = 0; upper < 2 && i + j + upper < level; upper++) {
+          quavis::cpu::Triangle part = quavis::cpu::grid_subtriangle(a, b, c, {i, j, upper == 1}, level);
+          if (quavis::cpu::intersect_triangle(part, {0, 0, 0}, direction) == FLT_MAX)
+            continue;
+          quavis::vec3 p = quavis::cpu::closest_point_to_origin(part.a, part.b, part.c);
+          nearest = std::min(nearest, sqrtf(p * p));
+        }
+      }
+    }
+  }
+  return nearest;
+}
+
+int main(int argc, char **argv) {
+  for (std::string kernel : {"scalar", "avx2", "avx512"})
+    check_kernel(kernel);
+
+  std::vector<std::string> metrics = {"area", "volume", "minradial", "maxradial", "skyratio"};
+  quavis::cpu::Context context(metrics);
+  std::vector<quavis::vec3> points = {{0, 0, 0}};
+  float r_max = 10;
+
+  // nothing visible: everything is at r_max
+  std::string empty = "{\"type\":\"FeatureCollection\",\"features\":[]}";
+  std::map<std::string, std::vector<float>> results = context.Parse(empty, points, 0.1, r_max, metrics);
+  check("empty area", results["area"][0], M_PI, 0.01);
+  check("empty volume", results["volume"][0], 4*M_PI/3, 0.01);
+  check("empty minradial", results["minradial"][0], 0, 0);
+  check("empty maxradial", results["maxradial"][0], 1, 0);
+  check("empty skyratio", results["skyratio"][0], 1, 0.01);
+
+  // closed cube: volume 8, nearest wall at 1, farthest corner at sqrt(3)
+  results = context.Parse(cube(), points, 0.1, r_max, metrics);
+  check("cube volume", results["volume"][0] * r_max*r_max*r_max, 8, 0.2);
+  check("cube minradial", results["minradial"][0] * r_max, 1, 0.01);
+  check("cube maxradial", results["maxradial"][0] * r_max, 1, 0.01);
+  check("cube skyratio", results["skyratio"][0], 0, 0);
+
+  // a long wall seen obliquely: the nearest mode takes the subtriangle the
+  // ray hits, not the foot of the wall at distance 1. The subtriangles are
+  // evenly spaced in angle, so the one hit at y = 50 reaches down to y ~ 9.
+  std::vector<quavis::cpu::Triangle> wall = {
+    {{1, 0, -1}, {1, 100, -1}, {1, 100, 1}},
+    {{1, 0, -1}, {1, 100, 1}, {1, 0, 1}}
+  };
+  quavis::cpu::Bvh wall_bvh = quavis::cpu::build_bvh(wall);
+  quavis::vec3 oblique = {1.0f / sqrtf(2501), 50.0f / sqrtf(2501), 0};
+  float hit = quavis::cpu::intersect(wall_bvh, {0, 0, 0}, oblique, 1000);
+  float nearest = quavis::cpu::intersect_nearest(wall_bvh, {0, 0, 0}, oblique, 1000, 0.1);
+  check("oblique wall hit", hit, sqrtf(2501), 0.01);
+  check("oblique wall nearest", nearest, tessellated_nearest(wall, {0, 0, 0}, oblique, 0.1), 1e-3);
+  check("oblique wall nearest beyond the foot", nearest > 5, 1, 0);
+  check("perpendicular wall nearest", quavis::cpu::intersect_nearest(wall_bvh, {0, 0, 0}, {1, 0, 0}, 1000, 0.1), 1, 0.01);
+
+  // throughput on a grid of observers
+  std::vector<quavis::vec3> grid = {};
+  for (int i = 0; i < 1000; i++)
+    grid.push_back({-0.9f + 1.8f * (i % 10) / 9, -0.9f + 1.8f * (i / 10 % 10) / 9, -0.9f + 1.8f * (i / 100) / 9});
+  for (std::string kernel : {"scalar", "avx2", "avx512"}) {
+    quavis::cpu::Context timed(metrics, 0, 128, 64, kernel);
+    if (timed.GetKernelName() != kernel)
+      continue;
+    // the metrics of the center and of the nearest render mode
+    for (std::vector<std::string> mode : {std::vector<std::string> {"area", "volume", "skyratio"}, {"minradial", "maxradial"}}) {
+      auto start = std::chrono::steady_clock::now();
+      timed.Parse(cube(), grid, 0.1, r_max, mode);
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      std::cout << grid.size() << " observers in " << elapsed.count() << " s (" << kernel << ", " << mode[0] << ")" << std::endl;
+    }
+  }
+  return failures > 0;
+}
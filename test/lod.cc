@@ -0,0 +1,146 @@
+#include "quavis/vk/geometry/geojson.hpp"
+#include "quavis/vk/geometry/lod.hpp"
+#include "quavis/cpu/bvh.hpp"
+
+#include <iostream>
+#include <random>
+
+// Checks that the simplified level of detail only replaces building-like
+// features where that saves triangles, that the distances seen from
+// observers (and thus the metrics) do not change on a scene with a courtyard
+// and that a round tower moves by at most the tolerance:
+//   g++ -std=c++14 -O2 -Iinclude test/lod.cc
+
+std::string polygon(std::vector<std::vector<quavis::vec3>> rings) {
+  std::string coordinates = "";
+  for (size_t r = 0; r < rings.size(); r++) {
+    coordinates += r > 0 ? ",[" : "[";
+    for (quavis::vec3 p : rings[r])
+      coordinates += "[" + std::to_string(p.x) + "," + std::to_string(p.y) + "," + std::to_string(p.z) + "],";
+    coordinates += "[" + std::to_string(rings[r][0].x) + "," + std::to_string(rings[r][0].y) + "," + std::to_string(rings[r][0].z) + "]]";
+  }
+  return "[" + coordinates + "]";
+}
+
+// a building with flat roof on the footprint, optionally with a courtyard
+std::string building(std::vector<quavis::vec2> outer, std::vector<quavis::vec2> inner, float height) {
+  std::vector<std::string> polygons = {};
+  std::vector<std::vector<quavis::vec3>> roof = {{}};
+  for (std::vector<quavis::vec2> ring : {outer, inner}) {
+    for (size_t i = 0; i < ring.size(); i++) {
+      quavis::vec2 a = ring[i], b = ring[(i + 1) % ring.size()];
+      polygons.push_back(polygon({{{a.x, a.y, 0}, {b.x, b.y, 0}, {b.x, b.y, height}, {a.x, a.y, height}}}));
+    }
+    if (ring.size() > 0 && roof.back().size() > 0)
+      roof.push_back({});
+    for (quavis::vec2 p : ring)
+      roof.back().push_back({p.x, p.y, height});
+  }
+  polygons.push_back(polygon(roof));
+
+  std::string coordinates = "";
+  for (size_t p = 0; p < polygons.size(); p++)
+    coordinates += (p > 0 ? "," : "") + polygons[p];
+  return "{\"type\":\"Feature\",\"geometry\":{\"type\":\"MultiPolygon\",\"coordinates\":[" + coordinates + "]}}";
+}
+
+// sloped terrain below the buildings
+std::string terrain() {
+  return "{\"type\":\"Feature\",\"geometry\":{\"type\":\"Polygon\",\"coordinates\":"
+    + polygon({{{-50, -50, -1}, {80, -50, -1}, {80, 80, -0.5}, {-50, 80, -0.5}}}) + "}}";
+}
+
+int failures = 0;
+
+void check(std::string name, size_t value, size_t expected) {
+  bool ok = value == expected;
+  failures += !ok;
+  std::cout << (ok ? "OK   " : "FAIL ") << name << ": " << value << " (expected " << expected << ")" << std::endl;
+}
+
+bool same(const std::vector<quavis::vec3>& a, const std::vector<quavis::vec3>& b) {
+  return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](quavis::vec3 p, quavis::vec3 q) {
+    return p.x == q.x && p.y == q.y && p.z == q.z;
+  });
+}
+
+quavis::cpu::Bvh to_bvh(const std::vector<std::vector<quavis::vec3>>& features) {
+  std::vector<quavis::cpu::Triangle> triangles = {};
+  for (const std::vector<quavis::vec3>& feature : features) {
+    for (size_t i = 0; i + 2 < feature.size(); i += 3)
+      triangles.push_back({feature[i], feature[i+1], feature[i+2]});
+  }
+  return quavis::cpu::build_bvh(triangles);
+}
+
+int main(int argc, char **argv) {
+  std::vector<quavis::vec2> round = {};
+  for (int i = 0; i < 32; i++)
+    round.push_back({(float)(80 + 8 * cos(2 * M_PI * i / 32)), (float)(80 + 8 * sin(2 * M_PI * i / 32))});
+  std::string scene = "{\"type\":\"FeatureCollection\",\"features\":["
+    + building({{0, 0}, {30, 0}, {30, 30}, {0, 30}}, {{10, 10}, {20, 10}, {20, 20}, {10, 20}}, 10) + ","
+    + building({{40, 0}, {60, 0}, {60, 20}, {40, 20}}, {}, 15) + ","
+    + building({{0, 40}, {30, 40}, {30, 50}, {10, 50}, {10, 70}, {0, 70}}, {}, 12) + ","
+    + terrain() + ","
+    + building(round, {}, 20) + "]}";
+  std::vector<std::vector<quavis::vec3>> features = quavis::geojson::parse_features(scene);
+  check("features", features.size(), 5);
+  float tolerance = 0.5;
+
+  std::vector<std::vector<quavis::vec3>> simplified = {};
+  for (const std::vector<quavis::vec3>& feature : features) {
+    quavis::vec3 min = feature[0], max = feature[0];
+    for (quavis::vec3 p : feature) {
+      min = {std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z)};
+      max = {std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z)};
+    }
+    simplified.push_back(quavis::lod::simplify(feature, min.z, max.z, tolerance));
+  }
+  check("courtyard exact", same(simplified[0], features[0]), 1);
+  check("box exact", same(simplified[1], features[1]), 1);
+  check("concave exact", same(simplified[2], features[2]), 1);
+  check("terrain exact", same(simplified[3], features[3]), 1);
+  check("tower simplified", same(simplified[4], features[4]), 0);
+
+  size_t exact_triangles = 0, simplified_triangles = 0;
+  for (size_t f = 0; f < features.size(); f++) {
+    exact_triangles += features[f].size() / 3;
+    simplified_triangles += simplified[f].size() / 3;
+  }
+  check("fewer triangles", simplified_triangles < exact_triangles, 1);
+  std::cout << "INFO: " << exact_triangles << " exact and " << simplified_triangles << " simplified triangles" << std::endl;
+
+  // the same distances in every direction, from the courtyard and outside,
+  // in the scene without the tower
+  std::vector<quavis::vec3> exact_tower = features.back(), simplified_tower = simplified.back();
+  features.pop_back();
+  simplified.pop_back();
+  quavis::cpu::Bvh exact = to_bvh(features), hull = to_bvh(simplified);
+  std::mt19937 random(1);
+  std::normal_distribution<float> normal(0, 1);
+  for (quavis::vec3 observer : std::vector<quavis::vec3> {{15, 15, 1}, {35, 10, 2}, {-10, 60, 5}}) {
+    size_t mismatches = 0;
+    for (int r = 0; r < 10000; r++) {
+      quavis::vec3 d = {normal(random), normal(random), normal(random)};
+      d = d * (1.0f / sqrtf(d * d));
+      float expected = quavis::cpu::intersect(exact, observer, d, 1000);
+      float distance = quavis::cpu::intersect(hull, observer, d, 1000);
+      if (expected == FLT_MAX ? distance != FLT_MAX : fabs(distance - expected) > 1e-3 * expected)
+        mismatches++;
+    }
+    check("mismatches at " + std::to_string(observer.x) + "," + std::to_string(observer.y), mismatches, 0);
+  }
+
+  // the walls of the tower seen from its center move by at most the tolerance
+  quavis::cpu::Bvh tower = to_bvh({exact_tower}), tower_hull = to_bvh({simplified_tower});
+  size_t moved = 0;
+  for (int r = 0; r < 3600; r++) {
+    quavis::vec3 d = {(float)cos(2 * M_PI * r / 3600), (float)sin(2 * M_PI * r / 3600), 0};
+    float expected = quavis::cpu::intersect(tower, {80, 80, 10}, d, 1000);
+    float distance = quavis::cpu::intersect(tower_hull, {80, 80, 10}, d, 1000);
+    if (fabs(distance - expected) > tolerance)
+      moved++;
+  }
+  check("tower moved beyond the tolerance", moved, 0);
+  return failures > 0;
+}
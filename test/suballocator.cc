@@ -0,0 +1,64 @@
+#include "quavis/vk/memory/suballocator.hpp"
+
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Checks the free list of the arenas of the sub-allocator: alignment, reuse
+// and coalescing of freed ranges. Only links against the Vulkan loader:
+//   g++ -std=c++14 -Iinclude test/suballocator.cc -lvulkan
+
+int failures = 0;
+
+void check(std::string name, uint64_t value, uint64_t expected) {
+  bool ok = value == expected;
+  failures += !ok;
+  std::cout << (ok ? "OK   " : "FAIL ") << name << ": " << value << " (expected " << expected << ")" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  quavis::FreeList list(1024);
+  VkDeviceSize a, b, c;
+  list.Take(100, 1, a);
+  list.Take(100, 256, b);
+  list.Take(100, 1, c);
+  check("first offset", a, 0);
+  check("aligned offset", b, 256);
+  check("padding reused", c, 100);
+  check("used bytes", list.GetUsed(), 300);
+
+  // the aligned range is merged with the free ranges on both sides
+  list.Give(b, 100);
+  check("merged ranges", list.GetRangeCount(), 1);
+  list.Give(a, 100);
+  check("separate ranges", list.GetRangeCount(), 2);
+  list.Give(c, 100);
+  check("coalesced ranges", list.GetRangeCount(), 1);
+  check("empty", list.IsEmpty(), 1);
+
+  VkDeviceSize d;
+  check("too large", list.Take(2048, 1, d), 0);
+  check("whole arena", list.Take(1024, 1, d), 1);
+
+  // random allocations and frees always coalesce to one range again
+  quavis::FreeList random(1 << 20);
+  std::mt19937 generator(42);
+  std::vector<std::pair<VkDeviceSize, VkDeviceSize>> taken = {};
+  for (int i = 0; i < 10000; i++) {
+    if (taken.empty() || generator() % 3 != 0) {
+      VkDeviceSize size = 1 + generator() % 4096;
+      VkDeviceSize offset;
+      if (random.Take(size, 1 << (generator() % 9), offset))
+        taken.push_back({offset, size});
+    } else {
+      size_t index = generator() % taken.size();
+      random.Give(taken[index].first, taken[index].second);
+      taken.erase(taken.begin() + index);
+    }
+  }
+  for (auto& range : taken)
+    random.Give(range.first, range.second);
+  check("random coalesced ranges", random.GetRangeCount(), 1);
+  check("random empty", random.IsEmpty(), 1);
+  return failures > 0;
+}